@@ -0,0 +1,40 @@
+// A translation unit with many properties, to measure how long qcppc
+// takes to compile (see compile_time.sh). It only uses the oldest parts of
+// the API, so that it also builds against previous versions.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../quickcppcheck/property.hpp"
+
+using namespace qcppc;
+
+#define BENCH_PROPERTIES(T) \
+    ok &= property([](T a) { return a == a; }, #T " equals itself", 0)(10); \
+    ok &= property([](T a, T b) { return (a < b) != (b < a) || a == b; }, \
+            #T " is ordered", 0)(10); \
+    ok &= property([](T a, T b, T c) { return std::min(a, std::min(b, c)) == \
+                std::min(std::min(a, b), c); }, #T " min is associative", 0)(10); \
+    ok &= property([](T a, const std::vector<T> & v) { return v.size() < 1000 || a == a; }, \
+            #T " with a vector", 0)(10); \
+    ok &= property([](const std::vector<T> & v) { std::vector<T> r(v.rbegin(), v.rend()); \
+                std::reverse(r.begin(), r.end()); return r == v; }, \
+            #T " reverse twice", 0)(10); \
+    ok &= property([](T a, int n, const std::string & s) { return s.size() < 1000 || a == a || n; }, \
+            #T " with int and string", 0)(10);
+
+int main()
+{
+    bool ok = true;
+    BENCH_PROPERTIES(char)
+    BENCH_PROPERTIES(int)
+    BENCH_PROPERTIES(unsigned int)
+    BENCH_PROPERTIES(long)
+    BENCH_PROPERTIES(unsigned long)
+    BENCH_PROPERTIES(long long)
+    BENCH_PROPERTIES(float)
+    BENCH_PROPERTIES(double)
+    BENCH_PROPERTIES(std::string)
+    BENCH_PROPERTIES(std::vector<int>)
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Measures how long compile_bench.cpp takes to compile.
+#
+#   ./compile_time.sh [REV]
+#
+# Times the build against the headers of the working tree, header only
+# and with libqcppc, and, if a git revision is given, against the headers
+# of that revision too, for comparison. CXX, CXXFLAGS and RUNS (the number
+# of builds to take the best of, default 3) can be set in the environment.
+
+set -e
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-std=c++17 -O2 -pthread"}
+RUNS=${RUNS:-3}
+HERE=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# best SRC_DIR EXTRA_FLAGS...: prints the fastest of RUNS builds, in seconds.
+best() {
+    dir=$1
+    shift
+    best=
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(date +%s.%N)
+        $CXX $CXXFLAGS "$@" -c "$dir/bench/compile_bench.cpp" -o "$TMP/bench.o"
+        end=$(date +%s.%N)
+        best=$(awk -v s="$start" -v e="$end" -v b="$best" \
+                'BEGIN { t = e - s; if (b == "" || t < b) b = t; printf "%.2f", b }')
+        i=$((i + 1))
+    done
+    echo "$best"
+}
+
+if [ -n "$1" ]; then
+    mkdir -p "$TMP/rev/bench"
+    (cd "$HERE/.." && git archive "$1" quickcppcheck) | tar -x -C "$TMP/rev"
+    cp "$HERE/compile_bench.cpp" "$TMP/rev/bench/"
+    echo "$1, header only: $(best "$TMP/rev")s"
+fi
+
+echo "working tree, header only: $(best "$HERE/..")s"
+echo "working tree, with libqcppc: $(best "$HERE/.." -DQCPPC_USE_LIBRARY)s"
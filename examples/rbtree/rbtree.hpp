@@ -29,8 +29,8 @@ struct RBNode
 // A simple implementation of a Red-Black tree for demonstration purposes.
 //
 // WARNING: Class RBTree does not support "copy semantics",
-// that is, any attempt to copy or assign an object of this class will fail
-// at runtime with an assertion failure. It does, however, support
+// that is, any attempt to copy or assign an object of this class fails
+// to compile. It does, however, support
 // move semantics, and this is what we actually care about here since
 // QuickCppCheck does not copy any value, it only moves them.
 template<class T>
@@ -57,16 +57,8 @@ public:
     RBTree():m_size(0),m_root(nullptr) {}
 
     // No copy constructor & copy assignment operator.
-    // We can't delete or make them private since quickcppcheck
-    // requires them in order to compile.
-    // TODO: implement them!
-    RBTree(const RBTree<T>&) {
-        assert(false);
-    }
-    RBTree<T>& operator=(const RBTree<T>&) {
-        assert(false);
-        return *this;
-    }
+    RBTree(const RBTree<T>&) = delete;
+    RBTree<T>& operator=(const RBTree<T>&) = delete;
 
     // Move operations.
     RBTree(RBTree<T> && other):m_size(other.m_size),m_root(other.m_root){
@@ -2,7 +2,12 @@
 #include <unistd.h>
 
 #include "rbtree.hpp"
+// Counts allocations, for the leak checks of the trees.
+#define QCPPC_COUNT_ALLOCATIONS
 #include "../../quickcppcheck/property.hpp"
+#include "../../quickcppcheck/complexity.hpp"
+#include "../../quickcppcheck/stateful.hpp"
+#include "../../quickcppcheck/suite.hpp"
 
 using namespace qcppc;
 using namespace rbtree;
@@ -139,31 +144,6 @@ bool _longest_path_not_more_than_twice_the_shortest(const RBTree<T>& tree)
 // -------------------------------------------------------------------
 
 
-// -------------------------------------------------------------------
-// Helper struct to test RBTree against std::set
-template<class T>
-struct RBTreeVsStdSet
-{
-    RBTree<T> tree;
-    std::set<T> set;
-
-    void insert(const T & t) {
-        tree.insert(t);
-        set.insert(t);
-    }
-    void remove(const T & t) {
-        tree.remove(t);
-        set.erase(t);
-    }
-    bool findBoth(const T & t) const {
-        return tree.find(t) == (set.find(t) != set.end());
-    }
-
-    bool sizeBoth() const {
-        return tree.size() == set.size();
-    }
-};
-// --------------------------------------------------------------------
 
 
 // -------------------------------------------------------------------
@@ -171,15 +151,22 @@ struct RBTreeVsStdSet
 //
 // Checks properties for find operation.
 template<class T>
-void test_find(const std::string & id)
+bool test_find(const std::string & id)
 {
-    property([](RBTree<T>& tree, const std::vector<T>& v)
+    bool ok = true;
+    ok &= property([](RBTree<T>& tree, const std::vector<T>& v)
             { for (auto i:v) tree.insert(i);
               for (auto i:v) if (!tree.find(i)) return false;
+              collect("tree size", tree.size());
               return true; },
             id + "[Find] All values inserted in a RBTree should be found.")
         // generate vectors of up to 1000 elements
         .template Rnd<1>(0, 1000)
+        .Collect("values", [](RBTree<T>&, const std::vector<T>& v) { return v.size(); })
+        .Classify([](RBTree<T>&, const std::vector<T>& v)
+            { return v.size() < 100 ? "fewer than 100 values" : "100 values or more"; })
+        // report the cycles, cache and branch misses per call
+        .Perf()
         ();
 
     /*
@@ -193,29 +180,32 @@ void test_find(const std::string & id)
         .template One<1>(vals)
     ();
     */
+    return ok;
 }
 
 // Checks properties for insert operation.
 // We can check directly the random generated trees, since
 // they are generated using the insert operation.
 template<class T>
-void test_insert(const std::string & id)
+bool test_insert(const std::string & id)
 {
-    property(_is_valid_BST<T>,
+    bool ok = true;
+    ok &= property(_is_valid_BST<T>,
         id + "[Insert] A Red-Black Tree is a BST.")
     ();
 
-    property(_all_red_node_children_are_black<T>,
+    ok &= property(_all_red_node_children_are_black<T>,
         id + "[Insert] All children of RED nodes should be BLACK (or NULL).")
     ();
 
-    property(_longest_path_not_more_than_twice_the_shortest<T>,
+    ok &= property(_longest_path_not_more_than_twice_the_shortest<T>,
         id + "[Insert] Longest path to a leaf should not be more than twice the shortest.")
     ();
 
-    property(_n_black_nodes<T>,
+    ok &= property(_n_black_nodes<T>,
         id + "[Insert] All paths from a given node to leaves should have the same number of black nodes.")
     ();
+    return ok;
 }
 
 template<class T>
@@ -232,20 +222,22 @@ struct test_size<RBTree<T>> { static const int min = 0; static const int max = 1
 
 // Checks properties for remove operation.
 template<class T>
-void test_remove(const std::string & id)
+bool test_remove(const std::string & id)
 {
+    bool ok = true;
     int min_tree_size = test_size<RBTree<T>>::min,
         max_tree_size = test_size<RBTree<T>>::max;
     auto gen = Arbitrary<T>(test_size<T>::min, test_size<T>::max);
 
-    property([](RBTree<T> &tree, const T& t)
+    ok &= property([](RBTree<T> &tree, const T& t)
             { tree.insert(t);
               tree.remove(t);
               return !tree.find(t); },
         id + "[Remove] Removed elements should not be found.")
+        .NoLeaks()
     ();
 
-    property([](RBTree<T> &tree, const T& t)
+    ok &= property([](RBTree<T> &tree, const T& t)
             { tree.remove(t);
               return _is_valid_BST(tree); },
         id + "[Remove] Tree remains valid BST.",1)
@@ -253,7 +245,7 @@ void test_remove(const std::string & id)
         .template Rnd<1>(gen)
     ();
 
-    property([](RBTree<T> &tree, const T& t)
+    ok &= property([](RBTree<T> &tree, const T& t)
             { tree.remove(t);
               return _all_red_node_children_are_black(tree);},
         id + "[Remove] All children of RED nodes should be BLACK (or NULL).")
@@ -263,7 +255,7 @@ void test_remove(const std::string & id)
                 { return tree.find(t)?"Present in tree":"Not present in tree";})
     ();
 
-    property([](RBTree<T>& tree, const T& t)
+    ok &= property([](RBTree<T>& tree, const T& t)
             { tree.remove(t);
               return _longest_path_not_more_than_twice_the_shortest(tree);},
         id + "[Remove] Longest path to a leaf should not be more than twice the shortest.")
@@ -301,14 +293,16 @@ void test_remove(const std::string & id)
                 { return tree.find(t)?"Present in tree":"Not present in tree";})
     ();
     */
+    return ok;
 }
 
 template<class T>
-void test_remove2()
+bool test_remove2()
 {
+    bool ok = true;
     std::vector<T> v = Arbitrary<std::vector<T>>(Arbitrary<T>(0,10000), 2000, 2000)();
     RBTree<T> tree = fromVector(v);
-    property([&tree](T n)
+    ok &= property([&tree](T n)
             { tree.remove(n);
               return _all_red_node_children_are_black(tree); },
         "[Remove] All red node children are black.",1)
@@ -318,7 +312,7 @@ void test_remove2()
     ();
 
     auto gen = Arbitrary<T>(0, 10);
-    property([] (RBTree<T> &tree, const T &t)
+    ok &= property([] (RBTree<T> &tree, const T &t)
             { tree.remove(t);
               return _all_red_node_children_are_black(tree); },
         "[Remove] All red node children are black.",1)
@@ -327,21 +321,59 @@ void test_remove2()
         .template Rnd<0>(gen, 1000, 2000)
         .template Rnd<1>(gen)
     ();
+    return ok;
 }
 
 template<class T>
-void test_set()
+bool test_set()
 {
-    RBTreeVsStdSet<T> ts;
+    bool ok = true;
+    ok &= stateful<RBTree<T>, std::set<T>>("RBTree should behave similarly to std::set.")
+        .Command("insert", Arbitrary<T>(0, 1000),
+            [](RBTree<T> &tree, const T &t) { tree.insert(t); return tree.find(t); },
+            [](std::set<T> &set, const T &t) { set.insert(t); return true; })
+        .Weight(2)
+        .Command("remove", Arbitrary<T>(0, 1000),
+            [](RBTree<T> &tree, const T &t) { tree.remove(t); return tree.find(t); },
+            [](std::set<T> &set, const T &t) { set.erase(t); return false; })
+        .Command("find", Arbitrary<T>(0, 1000),
+            [](RBTree<T> &tree, const T &t) { return tree.find(t); },
+            [](std::set<T> &set, const T &t) { return set.count(t) > 0; })
+        .Invariant([](const RBTree<T> &tree, const std::set<T> &set)
+            { return tree.size() == set.size(); })
+    (1000, 2000);
+    return ok;
+}
 
-    property([&ts] (const T & t, bool op)
-            { if (op) ts.insert(t); else ts.remove(t);
-              return ts.findBoth(t) && ts.sizeBoth(); },
-        "RBTree should behave similarly to std::set.")
-        .template Rnd<0>(0, 1000)
-        .template Frq<1>({{true, 2},{false, 1}})
-    (1000000);
+// Checks that insert and find stay logarithmic.
+// Each sample times a batch of operations on a tree of size n, so
+// that a single operation does not drown in the clock resolution.
+template<class T>
+bool test_complexity(const std::string & id)
+{
+    bool ok = true;
+    typedef std::pair<RBTree<T>, std::vector<T>> Input;
+    auto gen = [](size_t n)
+            { Input in(Arbitrary<RBTree<T>>(n, n)(),
+                       Arbitrary<std::vector<T>>(100, 100)());
+              return in; };
+
+    ok &= complexity([](Input &in)
+            { for (auto &t:in.second) in.first.insert(t); },
+        Order::O_LOG_N,
+        id + "[Complexity] Insert should be logarithmic.")
+        .Gen(gen)
+    ();
 
+    ok &= complexity([](Input &in)
+            { volatile bool found = false;
+              for (auto &t:in.second) found = in.first.find(t);
+              (void)found; },
+        Order::O_LOG_N,
+        id + "[Complexity] Find should be logarithmic.")
+        .Gen(gen)
+    ();
+    return ok;
 }
 // --------------- Tests ------------------------------------------
 // ----------------------------------------------------------------
@@ -359,17 +391,19 @@ void animate(int n)
     }
 }
 
-int main()
+QCPPC_TEST(find_int) { return test_find<int>("int "); }
+QCPPC_TEST(find_string) { return test_find<std::string>("string "); }
+QCPPC_TEST(insert_int) { return test_insert<int>("int "); }
+QCPPC_TEST(insert_string) { return test_insert<std::string>("string "); }
+QCPPC_TEST(remove_int) { return test_remove<int>("int "); }
+QCPPC_TEST(remove_string) { return test_remove<std::string>("string "); }
+QCPPC_TEST(set_int) { return test_set<int>(); }
+// Timing measurements should not compete with other tests for the cores.
+QCPPC_TEST_EXCLUSIVE(complexity_int) { return test_complexity<int>("int "); }
+
+int main(int argc, char **argv)
 {
-    test_find<int>("int ");
-    test_find<std::string>("string ");
-    test_insert<int>("int ");
-    test_insert<std::string>("string ");
-    test_remove<int>("int ");
-    test_remove<std::string>("string ");
     //test_remove2<int>();
     //test_remove2<std::string>();
-    test_set<int>();
-    return 0;
+    return run_suite(argc, argv);
 }
-
@@ -3,6 +3,8 @@
 #include <algorithm>
 
 #include "../../quickcppcheck/property.hpp"
+#include "../../quickcppcheck/stateful.hpp"
+#include "../../quickcppcheck/combinators.hpp"
 
 namespace std {
 
@@ -30,6 +32,21 @@ int my_rand() {
     return rand() % 100;
 }
 
+// A stack that silently drops pushes once it holds 4 elements.
+struct BuggyStack {
+    std::vector<int> v;
+    void push(int x) { if (v.size() < 4) v.push_back(x); }
+    int pop() { if (v.empty()) return -1; int x = v.back(); v.pop_back(); return x; }
+};
+
+// A counter whose increment is not atomic: the read and the write
+// are atomic on their own, but another thread can run in between.
+struct RacyCounter {
+    std::atomic<int> n;
+    RacyCounter():n(0) {}
+    int inc() { int v = n.load(); std::this_thread::yield(); n.store(v + 1); return v; }
+};
+
 struct fun {
     bool operator()(int &x) {
         return x % 10 == 0;
@@ -76,6 +93,15 @@ void test_various()
         .Rnd<0>(MyArbitrary())
     (1000);
 
+    // The same generator as MyArbitrary, out of combinators: 666 in one
+    // case out of 100, otherwise multiples of 10.
+    property(fun(),
+        "This fails with input 666 too.")
+        .Rnd<0>(gen::map(gen::zip(Arbitrary<int>(0, 99), Arbitrary<int>(0, 99)),
+                    [](const std::tuple<int, int> & t) {
+                        return std::get<0>(t) == 1 ? 666 : std::get<1>(t) * 10; }))
+    (1000);
+
     property([] (int x, std::string s)
                                 {return true;},
         "Test", 2)
@@ -143,6 +169,24 @@ void test_various()
     property(prop_test)
         .Rnd<0>(my_rand)();
 
+    stateful<BuggyStack, std::vector<int>>(
+            "This fails after 5 pushes, shrunk to 5 pushes and a pop.")
+        .Command("push", Arbitrary<int>(0, 9),
+            [](BuggyStack &s, const int &x) { s.push(x); },
+            [](std::vector<int> &v, const int &x) { v.push_back(x); })
+        .Command("pop",
+            [](BuggyStack &s) { return s.pop(); },
+            [](std::vector<int> &v) { int x = v.back(); v.pop_back(); return x; })
+        .Pre([](const std::vector<int> &v) { return !v.empty(); })
+    (100, 50);
+
+    stateful<RacyCounter, int>("This fails, the counter is not linearizable.")
+        .Command("inc",
+            [](RacyCounter &c) { return c.inc(); },
+            [](int &n) { return n++; })
+        .Threads(3)
+    (100, 5);
+
     property(std::function<bool(bool,int)>([](bool,int){return true;}))
         .Rnd<1>(my_rand)
         .Classify([](bool b, int) { return b?"true":"false";})
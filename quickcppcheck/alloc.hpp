@@ -0,0 +1,377 @@
+// Allocation accounting for qcppc.
+//
+// Counts the allocations, bytes and live objects of every test of a
+// property (see Property::Allocations, NoLeaks and MaxAllocations), the
+// ones of the property function apart from the ones of the generation of
+// its input.
+//
+// Allocations are counted by replacing the global operator new and
+// operator delete, which must be done in exactly one source file of the
+// program, by defining QCPPC_COUNT_ALLOCATIONS before including this
+// header (or property.hpp):
+//
+//     #define QCPPC_COUNT_ALLOCATIONS
+//     #include "quickcppcheck/property.hpp"
+//
+// Only the allocations of the thread that runs the test are counted.
+
+#ifndef QCPPC_ALLOC_H_
+#define QCPPC_ALLOC_H_
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <new>
+#include <cstdlib>
+#include <cstdint>
+
+#include "extension.hpp"
+
+namespace qcppc {
+namespace detail {
+
+enum AllocPhase { ALLOC_OFF, ALLOC_GENERATION, ALLOC_PROPERTY, NUM_ALLOC_PHASES };
+
+struct AllocCounters
+{
+    int64_t allocations;
+    int64_t bytes;
+    int64_t live_objects;
+    int64_t live_bytes;
+    int64_t peak_bytes;
+};
+
+// What the allocations of this thread are counted for.
+inline AllocPhase & alloc_phase()
+{
+    static thread_local AllocPhase phase = ALLOC_OFF;
+    return phase;
+}
+
+inline AllocCounters * alloc_counters()
+{
+    static thread_local AllocCounters counters[NUM_ALLOC_PHASES];
+    return counters;
+}
+
+// Whether the operators that count are in the program.
+inline bool & alloc_counting_installed()
+{
+    static bool installed = false;
+    return installed;
+}
+
+// The test whose allocations this thread counts, which stamps the blocks
+// it allocates (see counted_allocate). Never 0, the stamp of the blocks
+// allocated while not counting.
+inline size_t & alloc_test_stamp()
+{
+    static thread_local size_t stamp = 1;
+    return stamp;
+}
+
+// Every block starts with a header that keeps its size, where the block
+// really starts (the header is bigger for over-aligned types) and the
+// stamp of the test that allocated it, if any, above that.
+static const size_t ALLOC_HEADER = 2 * sizeof(size_t);
+static const unsigned ALLOC_STAMP_SHIFT = sizeof(size_t) * 4;
+static const size_t ALLOC_OFFSET_MASK = (size_t(1) << ALLOC_STAMP_SHIFT) - 1;
+
+// Returns the stamp of the block.
+inline size_t count_allocation(size_t n)
+{
+    AllocPhase phase = alloc_phase();
+    if (phase == ALLOC_OFF) {
+        return 0;
+    }
+    AllocCounters & c = alloc_counters()[phase];
+    ++c.allocations;
+    c.bytes += n;
+    ++c.live_objects;
+    c.live_bytes += n;
+    c.peak_bytes = std::max(c.peak_bytes, c.live_bytes);
+    return alloc_test_stamp();
+}
+
+// Only the blocks of the current test are counted when they are freed:
+// others, e.g. allocated before the property ran, would cancel its leaks.
+inline void count_deallocation(size_t n, size_t stamp)
+{
+    AllocPhase phase = alloc_phase();
+    if (phase != ALLOC_OFF && stamp == alloc_test_stamp()) {
+        AllocCounters & c = alloc_counters()[phase];
+        --c.live_objects;
+        c.live_bytes -= n;
+    }
+}
+
+inline void * counted_allocate(size_t n, size_t align, bool nothrow)
+{
+    size_t header = std::max(ALLOC_HEADER, align);
+    void * base = align > ALLOC_HEADER ?
+        std::aligned_alloc(align, (header + n + align - 1) / align * align) :
+        std::malloc(header + n);
+    if (!base) {
+        if (nothrow) return nullptr;
+        throw std::bad_alloc();
+    }
+    size_t * p = reinterpret_cast<size_t*>(static_cast<char*>(base) + header);
+    p[-2] = n;
+    p[-1] = header | count_allocation(n) << ALLOC_STAMP_SHIFT;
+    return p;
+}
+
+inline void counted_deallocate(void * ptr)
+{
+    if (!ptr) return;
+    size_t * p = static_cast<size_t*>(ptr);
+    count_deallocation(p[-2], p[-1] >> ALLOC_STAMP_SHIFT);
+    std::free(static_cast<char*>(ptr) - (p[-1] & ALLOC_OFFSET_MASK));
+}
+
+// Keeps the accounting of the tests of a property.
+class AllocTracker
+{
+private:
+    // How many of the inputs with the highest peaks to report.
+    static const size_t TOP = 3;
+
+    bool check_leaks;
+    int64_t max_allocations;
+
+    uint64_t tests;
+    AllocCounters totals[NUM_ALLOC_PHASES];
+    std::vector<std::pair<int64_t, std::string>> top;
+
+public:
+    // max_allocations: the most allocations a test may do, 0 for no limit.
+    AllocTracker(bool check_leaks, int64_t max_allocations):
+        check_leaks(check_leaks), max_allocations(max_allocations), tests(0),
+        totals()
+    {}
+
+    void begin_test() {
+        size_t & stamp = alloc_test_stamp();
+        // Stamps have as many bits as the offsets below them.
+        stamp = (stamp + 1) & ALLOC_OFFSET_MASK;
+        if (stamp == 0) stamp = 1;
+        for (int p = 0;p < NUM_ALLOC_PHASES;++p) {
+            alloc_counters()[p] = AllocCounters();
+        }
+    }
+
+    void phase(AllocPhase p) {
+        alloc_phase() = p;
+    }
+
+    // Ends the test: destroys its input with destroy, which counts as part
+    // of the property. Returns why the test failed, if it did. The input is
+    // printed with print only if it is reported: before it is destroyed if
+    // it has one of the highest peaks or too many allocations, after if it
+    // leaks (print then draws it again).
+    std::string end_test(const std::function<void()> & destroy,
+            const std::function<std::string()> & print) {
+        AllocCounters & gen = alloc_counters()[ALLOC_GENERATION];
+        AllocCounters & prop = alloc_counters()[ALLOC_PROPERTY];
+        int64_t peak = prop.peak_bytes;
+        int64_t allocations = prop.allocations;
+        bool top_peak = top.size() < TOP || peak > top.back().first;
+        bool too_many = max_allocations && allocations > max_allocations;
+        std::string input;
+        if (top_peak || too_many) {
+            input = print();
+        }
+
+        phase(ALLOC_PROPERTY);
+        destroy();
+        phase(ALLOC_OFF);
+
+        ++tests;
+        for (int p = 0;p < NUM_ALLOC_PHASES;++p) {
+            totals[p].allocations += alloc_counters()[p].allocations;
+            totals[p].bytes += alloc_counters()[p].bytes;
+        }
+        if (top_peak) {
+            top.push_back(std::make_pair(peak, input));
+            std::stable_sort(top.begin(), top.end(),
+                    [](const std::pair<int64_t, std::string> & a,
+                       const std::pair<int64_t, std::string> & b) { return a.first > b.first; });
+            if (top.size() > TOP) top.pop_back();
+        }
+
+        std::ostringstream reason;
+        int64_t leaked = gen.live_objects + prop.live_objects;
+        if (check_leaks && leaked > 0) {
+            print();
+            reason<<"leaked "<<leaked<<" objects ("<<gen.live_bytes + prop.live_bytes
+                <<" bytes).";
+        } else if (too_many) {
+            reason<<"made "<<allocations<<" allocations, more than "<<max_allocations<<".";
+        }
+        return reason.str();
+    }
+
+    void print_results(std::ostream & out) const {
+        if (!alloc_counting_installed()) {
+            out<<"  allocations: not counted, QCPPC_COUNT_ALLOCATIONS is not defined"
+                " in any source file."<<std::endl;
+            return;
+        }
+        if (tests == 0) {
+            return;
+        }
+        const AllocCounters & gen = totals[ALLOC_GENERATION];
+        const AllocCounters & prop = totals[ALLOC_PROPERTY];
+        out<<"  allocations per test: "<<double(prop.allocations) / tests<<" ("
+            <<double(prop.bytes) / tests<<" bytes) in the property, "
+            <<double(gen.allocations) / tests<<" ("<<double(gen.bytes) / tests
+            <<" bytes) generating the input."<<std::endl;
+        if (!top.empty()) {
+            out<<"  highest peak memory:"<<std::endl;
+        }
+        for (auto &it:top) {
+            out<<"    "<<it.first<<" bytes for"<<std::endl;
+            print_indented(out, it.second, "      ");
+        }
+    }
+
+private:
+    // Prints every line of text after indent, but the empty ones.
+    static void print_indented(std::ostream & out, const std::string & text,
+            const std::string & indent) {
+        std::istringstream lines(text);
+        std::string line;
+        while (std::getline(lines, line)) {
+            out<<(line.empty() ? "" : indent)<<line<<std::endl;
+        }
+    }
+};
+
+// Counts the allocations of the tests of a property, see
+// Property::Allocations, NoLeaks and MaxAllocations.
+struct AllocExtension : Extension
+{
+    bool check_leaks;
+    int64_t max_allocations;
+
+    // The accounting of the last run, none for asynchronous properties.
+    std::shared_ptr<AllocTracker> tracker;
+
+    AllocExtension():check_leaks(false), max_allocations(0) {}
+
+    std::unique_ptr<Extension> clone() const override {
+        return std::make_unique<AllocExtension>(*this);
+    }
+
+    // A leaking input is printed once destroyed, see AllocTracker::end_test.
+    bool redraws_input() const override {
+        return check_leaks;
+    }
+
+    void begin_run(const std::string &, bool async, bool, bool) override {
+        tracker.reset();
+        if (!async) {
+            tracker = std::make_shared<AllocTracker>(check_leaks, max_allocations);
+        }
+    }
+
+    void begin_test(TestInput & input) override {
+        if (tracker) {
+            // Whatever the last test left (e.g. a skipped input) is not
+            // counted.
+            input.destroy();
+            tracker->begin_test();
+        }
+    }
+
+    void begin_generation() override {
+        alloc_phase() = ALLOC_GENERATION;
+    }
+
+    void end_generation() override {
+        alloc_phase() = ALLOC_OFF;
+    }
+
+    void begin_call() override {
+        alloc_phase() = ALLOC_PROPERTY;
+    }
+
+    void end_call(const std::string &) override {
+        alloc_phase() = ALLOC_OFF;
+    }
+
+    // The input is destroyed as part of the test, so that what it owns
+    // isn't taken for a leak.
+    std::string end_test(TestInput & input) override {
+        return tracker->end_test([&input]() { input.destroy(); },
+                [&input]() { return input.print(); });
+    }
+
+    void print_results(std::ostream & out) const override {
+        if (tracker) {
+            tracker->print_results(out);
+        }
+    }
+};
+
+} // namespace detail
+} // namespace qcppc
+
+#ifdef QCPPC_COUNT_ALLOCATIONS
+
+namespace qcppc {
+namespace detail {
+
+static bool alloc_counting_installer = (alloc_counting_installed() = true);
+
+} // namespace detail
+} // namespace qcppc
+
+void * operator new(std::size_t n)
+{
+    return qcppc::detail::counted_allocate(n, 0, false);
+}
+
+void * operator new[](std::size_t n)
+{
+    return qcppc::detail::counted_allocate(n, 0, false);
+}
+
+void * operator new(std::size_t n, const std::nothrow_t &) noexcept
+{
+    return qcppc::detail::counted_allocate(n, 0, true);
+}
+
+void * operator new[](std::size_t n, const std::nothrow_t &) noexcept
+{
+    return qcppc::detail::counted_allocate(n, 0, true);
+}
+
+void * operator new(std::size_t n, std::align_val_t a)
+{
+    return qcppc::detail::counted_allocate(n, size_t(a), false);
+}
+
+void * operator new[](std::size_t n, std::align_val_t a)
+{
+    return qcppc::detail::counted_allocate(n, size_t(a), false);
+}
+
+void operator delete(void * p) noexcept { qcppc::detail::counted_deallocate(p); }
+void operator delete[](void * p) noexcept { qcppc::detail::counted_deallocate(p); }
+void operator delete(void * p, std::size_t) noexcept { qcppc::detail::counted_deallocate(p); }
+void operator delete[](void * p, std::size_t) noexcept { qcppc::detail::counted_deallocate(p); }
+void operator delete(void * p, const std::nothrow_t &) noexcept { qcppc::detail::counted_deallocate(p); }
+void operator delete[](void * p, const std::nothrow_t &) noexcept { qcppc::detail::counted_deallocate(p); }
+void operator delete(void * p, std::align_val_t) noexcept { qcppc::detail::counted_deallocate(p); }
+void operator delete[](void * p, std::align_val_t) noexcept { qcppc::detail::counted_deallocate(p); }
+void operator delete(void * p, std::size_t, std::align_val_t) noexcept { qcppc::detail::counted_deallocate(p); }
+void operator delete[](void * p, std::size_t, std::align_val_t) noexcept { qcppc::detail::counted_deallocate(p); }
+
+#endif // QCPPC_COUNT_ALLOCATIONS
+
+#endif // QCPPC_ALLOC_H_
@@ -0,0 +1,280 @@
+// Performance baselines for qcppc.
+//
+// With Property::Baseline, the time of every call of the property
+// function is measured, and a uniform random sample of the times is
+// compared with the sample of a previous run, kept in a local file. The
+// property fails if its median got slower by more than a margin and a
+// Mann-Whitney U test on the two samples finds the slowdown significant,
+// even if all its tests pass. Baselines depend on the machine, so the
+// file should not be shared between different ones.
+
+#ifndef QCPPC_BASELINE_H_
+#define QCPPC_BASELINE_H_
+
+#include <iostream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <random>
+
+#include "store.hpp"
+#include "extension.hpp"
+
+namespace qcppc {
+namespace detail {
+
+// A uniform random sample of at most size of the values added, however
+// many there are (reservoir sampling). It draws from its own engine, so
+// that it doesn't change the inputs of the property.
+class Reservoir
+{
+private:
+    size_t size;
+    uint64_t added;
+    std::vector<double> sample;
+    std::minstd_rand engine;
+
+public:
+    Reservoir(size_t size):size(size), added(0) {}
+
+    void add(double x) {
+        ++added;
+        if (sample.size() < size) {
+            sample.push_back(x);
+            return;
+        }
+        uint64_t k = std::uniform_int_distribution<uint64_t>(0, added - 1)(engine);
+        if (k < size) {
+            sample[k] = x;
+        }
+    }
+
+    const std::vector<double> & values() const {
+        return sample;
+    }
+
+    void clear() {
+        added = 0;
+        sample.clear();
+    }
+};
+
+// The one-sided p-value of the Mann-Whitney U test for b tending to be
+// larger than a, with the normal approximation and a correction for ties.
+inline double mann_whitney_greater(const std::vector<double> & a, const std::vector<double> & b)
+{
+    size_t m = a.size(), n = b.size(), total = m + n;
+    if (m == 0 || n == 0) {
+        return 1;
+    }
+
+    // Ranks, ties get the average of their ranks.
+    std::vector<std::pair<double, bool>> all;
+    for (auto x:a) all.push_back(std::make_pair(x, false));
+    for (auto x:b) all.push_back(std::make_pair(x, true));
+    std::sort(all.begin(), all.end());
+
+    double rank_sum_b = 0, ties = 0;
+    for (size_t i = 0;i < total;) {
+        size_t j = i;
+        while (j < total && all[j].first == all[i].first) ++j;
+        double rank = (i + j + 1) / 2.0;
+        for (size_t k = i;k < j;++k) {
+            if (all[k].second) rank_sum_b += rank;
+        }
+        double t = j - i;
+        ties += t * t * t - t;
+        i = j;
+    }
+
+    double u = rank_sum_b - n * (n + 1) / 2.0;
+    double mean = m * n / 2.0;
+    double var = m * n / 12.0 * ((total + 1) - ties / (double(total) * (total - 1)));
+    if (var <= 0) {
+        return 1;
+    }
+    double z = (u - mean - 0.5) / std::sqrt(var);
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+// The outcome of a comparison with a baseline.
+struct BaselineResult
+{
+    // Whether there was a baseline to compare with.
+    bool compared;
+
+    bool regressed;
+
+    double old_median;
+    double new_median;
+    double p;
+};
+
+// The baselines of all the properties, in the file at path. Properties
+// are known by their names, which should be unique.
+class Baselines
+{
+private:
+    std::mutex mutex;
+    RecordFile file;
+
+    static double median(std::vector<double> v) {
+        std::sort(v.begin(), v.end());
+        size_t h = v.size() / 2;
+        return v.size() % 2 ? v[h] : (v[h - 1] + v[h]) / 2;
+    }
+
+public:
+    // Baselines keep a sample of this many call times.
+    static const size_t SAMPLES = 200;
+
+    // A slowdown is significant below this p-value.
+    static constexpr double ALPHA = 0.01;
+
+    Baselines(const std::string & path):file(path) {}
+
+    // The baselines kept in the file at path, shared by the properties
+    // that use the same file.
+    static std::shared_ptr<Baselines> open(const std::string & path) {
+        static std::mutex mutex;
+        static std::map<std::string, std::weak_ptr<Baselines>> all;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::shared_ptr<Baselines> b = all[path].lock();
+        if (!b) {
+            b = std::make_shared<Baselines>(path);
+            all[path] = b;
+        }
+        return b;
+    }
+
+    // Compares a sample of the call times of the property name with its
+    // baseline: it regressed if its median is more than margin (a
+    // fraction) slower and the difference is significant. Records the
+    // sample as the new baseline if there is none yet, or if update is
+    // set.
+    BaselineResult compare(const std::string & name, const std::vector<double> & now,
+            double margin, bool update) {
+        std::lock_guard<std::mutex> lock(mutex);
+        BaselineResult result = {false, false, 0, 0, 1};
+        if (now.empty()) {
+            return result;
+        }
+        result.new_median = median(now);
+
+        std::vector<double> before;
+        std::istringstream in(file.get(name));
+        double t;
+        while (in>>t) before.push_back(t);
+
+        if (!before.empty()) {
+            result.compared = true;
+            result.old_median = median(before);
+            result.p = mann_whitney_greater(before, now);
+            result.regressed = result.new_median > result.old_median * (1 + margin) &&
+                result.p < ALPHA;
+        }
+        if (before.empty() || update) {
+            std::ostringstream out;
+            out.precision(17);
+            for (auto t:now) out<<t<<" ";
+            file.put(name, out.str());
+            file.save();
+        }
+        return result;
+    }
+};
+
+// Whether the baselines should be replaced by the times of this run
+// (environment variable QCPPC_UPDATE_BASELINES=1).
+inline bool update_baselines()
+{
+    const char * env = std::getenv("QCPPC_UPDATE_BASELINES");
+    return env && std::string(env) == "1";
+}
+
+// Compares the call times of the property function with a baseline, see
+// Property::Baseline. Asynchronous and sharded properties are not timed.
+struct BaselineExtension : Extension
+{
+    std::shared_ptr<Baselines> baselines;
+    double margin;
+
+    // The property, whether its calls are timed in this run, a sample of
+    // their times and the comparison with the baseline, if it was made.
+    std::string name;
+    bool timed;
+    Reservoir times;
+    std::chrono::steady_clock::time_point start;
+    bool compared;
+    BaselineResult result;
+
+    BaselineExtension():margin(0), timed(false), times(Baselines::SAMPLES),
+        compared(false) {}
+
+    std::unique_ptr<Extension> clone() const override {
+        return std::make_unique<BaselineExtension>(*this);
+    }
+
+    bool prefers_one_process() const override {
+        return true;
+    }
+
+    void begin_run(const std::string & name, bool async, bool sharded, bool) override {
+        this->name = name;
+        timed = !async && !sharded;
+        times.clear();
+        compared = false;
+    }
+
+    void begin_call() override {
+        start = std::chrono::steady_clock::now();
+    }
+
+    void end_call(const std::string &) override {
+        times.add(std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count());
+    }
+
+    bool end_run(const RunCounts & counts, RunFailure & failure) override {
+        if (!timed) {
+            return true;
+        }
+        result = baselines->compare(name, times.values(), margin, update_baselines());
+        compared = true;
+        if (result.regressed) {
+            failure.title = "Slower";
+            failure.detail = "passed " + std::to_string(counts.tests) +
+                " tests, but slower than the baseline.";
+            return false;
+        }
+        return true;
+    }
+
+    void print_results(std::ostream & out) const override {
+        if (!compared) {
+            return;
+        }
+        if (!result.compared) {
+            out<<"  baseline: recorded, median "<<result.new_median * 1e9
+                <<" ns per call."<<std::endl;
+            return;
+        }
+        out<<"  baseline: median "<<result.new_median * 1e9<<" ns per call, "
+            <<result.old_median * 1e9<<" ns before ("<<std::showpos
+            <<std::round(100 * (result.new_median / result.old_median - 1))<<std::noshowpos
+            <<"%, p = "<<result.p<<")."<<std::endl;
+    }
+};
+
+} // namespace detail
+} // namespace qcppc
+
+#endif // QCPPC_BASELINE_H_
@@ -0,0 +1,207 @@
+// Result cache for qcppc.
+//
+// Remembers which properties passed, for which build of the test binary,
+// seed and number of tests, so that a rerun of an unchanged binary with the
+// same seed can skip them or run them with a reduced budget.
+//
+// The cache is off by default. It is turned on with qcppc::use_cache or
+// with the environment variable QCPPC_CACHE=<file>. Caching only makes sense
+// when the seed is fixed (QCPPC_SEED), since another seed means other tests.
+
+#ifndef QCPPC_CACHE_H_
+#define QCPPC_CACHE_H_
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <cstdlib>
+#include <cstdint>
+
+#if defined(__linux__)
+#include <link.h>
+#include <elf.h>
+#endif
+
+#include "hash.hpp"
+#include "generator.hpp"
+#include "store.hpp"
+
+namespace qcppc {
+namespace detail {
+
+#if defined(__linux__)
+// Reads the GNU build-id note of the main executable, if it has one.
+inline int find_build_id(struct dl_phdr_info * info, size_t, void * data)
+{
+    // The main executable is the first object and has an empty name.
+    if (info->dlpi_name && info->dlpi_name[0]) {
+        return 1;
+    }
+    std::string & id = *static_cast<std::string*>(data);
+    for (int i = 0;i < info->dlpi_phnum;++i) {
+        const ElfW(Phdr) & ph = info->dlpi_phdr[i];
+        if (ph.p_type != PT_NOTE) {
+            continue;
+        }
+        const char * p = reinterpret_cast<const char*>(info->dlpi_addr + ph.p_vaddr);
+        const char * end = p + ph.p_memsz;
+        while (p + sizeof(ElfW(Nhdr)) <= end) {
+            const ElfW(Nhdr) * note = reinterpret_cast<const ElfW(Nhdr)*>(p);
+            const char * name = p + sizeof(ElfW(Nhdr));
+            const char * desc = name + ((note->n_namesz + 3) & ~3u);
+            if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+                    std::string(name, 3) == "GNU") {
+                std::ostringstream ss;
+                ss<<std::hex<<std::setfill('0');
+                for (unsigned int b = 0;b < note->n_descsz;++b) {
+                    ss<<std::setw(2)<<(unsigned int)(unsigned char)desc[b];
+                }
+                id = ss.str();
+                return 1;
+            }
+            p = desc + ((note->n_descsz + 3) & ~3u);
+        }
+    }
+    return 1;
+}
+#endif
+
+// Identifies the build of the running binary: its build-id when it has
+// one, a hash of the executable file otherwise, or an empty string if
+// neither is available.
+inline std::string build_id()
+{
+    static const std::string id = []() {
+        std::string id;
+#if defined(__linux__)
+        dl_iterate_phdr(find_build_id, &id);
+        if (!id.empty()) {
+            return id;
+        }
+        std::ifstream exe("/proc/self/exe", std::ios::binary);
+        if (exe) {
+            uint64_t h = 0;
+            char buf[1 << 16];
+            while (exe.read(buf, sizeof(buf)) || exe.gcount()) {
+                for (std::streamsize i = 0;i < exe.gcount();++i) {
+                    h = hash_combine(h, (unsigned char)buf[i]);
+                }
+            }
+            std::ostringstream ss;
+            ss<<"hash-"<<std::hex<<h;
+            id = ss.str();
+        }
+#endif
+        return id;
+    }();
+    return id;
+}
+
+class ResultCache
+{
+private:
+    std::mutex mutex;
+    std::unique_ptr<RecordFile> file;
+
+    // The fraction of the tests to still run for cached properties.
+    double reduced;
+
+    // How many times each name was looked up, see key.
+    std::map<std::string, size_t> occurrences;
+
+    std::string value(unsigned int ntests) const {
+        std::ostringstream ss;
+        ss<<build_id()<<" "<<run_seed()<<" "<<ntests;
+        return ss.str();
+    }
+
+public:
+    ResultCache():reduced(0) {
+        const char * env = std::getenv("QCPPC_CACHE");
+        if (env && *env) {
+            open(env, 0);
+        }
+    }
+
+    static ResultCache & instance() {
+        static ResultCache cache;
+        return cache;
+    }
+
+    // Starts using the cache at path, or none if path is empty.
+    void open(const std::string & path, double reduced) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->reduced = reduced;
+        occurrences.clear();
+        file.reset(path.empty() || build_id().empty() ? nullptr : new RecordFile(path));
+    }
+
+    bool enabled() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return file != nullptr;
+    }
+
+    // The key of a property. Properties with the same name are told apart
+    // by the order in which they run, which is stable as long as they
+    // don't run concurrently; names should better be unique.
+    std::string key(const std::string & name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ostringstream ss;
+        ss<<name<<"#"<<occurrences[name]++;
+        return ss.str();
+    }
+
+    // Returns the number of tests to run for the property with the given
+    // key: ntests, unless it already passed them in this build with this
+    // seed, in which case the reduced budget (possibly 0). rerun is set to
+    // the number of the reduced run, counted from 1, or to 0 for a full
+    // one, so that every reduced run can draw other inputs.
+    unsigned int budget(const std::string & key, unsigned int ntests, unsigned int & rerun) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rerun = 0;
+        std::string v = value(ntests);
+        std::string stored = file ? file->get(key) : std::string();
+        if (file && stored.compare(0, v.size(), v) == 0 &&
+                (stored.size() == v.size() || stored[v.size()] == ' ')) {
+            rerun = 1 + std::strtoul(stored.c_str() + v.size(), nullptr, 10);
+            return ntests * reduced;
+        }
+        return ntests;
+    }
+
+    // Records the result of a run, full or the given reduced one.
+    void record(const std::string & key, unsigned int ntests, bool passed,
+            unsigned int rerun) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!file) {
+            return;
+        }
+        if (passed) {
+            std::ostringstream ss;
+            ss<<value(ntests)<<" "<<rerun;
+            file->put(key, ss.str());
+        } else {
+            file->erase(key);
+        }
+        file->save();
+    }
+};
+
+} // namespace detail
+
+// Turns on the result cache, kept in the file at path. Properties that
+// already passed the same number of tests with the same binary and seed
+// run reduced * ntests tests (none by default) instead, with inputs that
+// none of their previous runs drew. An empty path turns the cache off.
+inline void use_cache(const std::string & path = ".qcppc_cache", double reduced = 0)
+{
+    detail::ResultCache::instance().open(path, reduced);
+}
+
+} // namespace qcppc
+
+#endif // QCPPC_CACHE_H_
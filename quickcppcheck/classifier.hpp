@@ -1,16 +1,239 @@
 #ifndef QCPPC_CLASSIFY_H_
 #define QCPPC_CLASSIFY_H_
 
+#include <iostream>
 #include <string>
+#include <vector>
+#include <functional>
 #include <map>
 #include <tuple>
 #include <algorithm>
 #include <iomanip>
 #include <cmath>
+#include <memory>
+#include <cstdlib>
 
 #include "utils.hpp"
+#include "extension.hpp"
 
 namespace qcppc {
+namespace detail {
+
+// Prints the frequencies of the classes, the most frequent first.
+// It doesn't depend on the types of the arguments, so that it is compiled
+// once rather than for every Classifier.
+inline void print_classes(std::ostream & out,
+        const std::map<std::string, size_t> & classes, size_t total)
+{
+    typedef std::pair<size_t, std::string> pair_type;
+    std::vector<pair_type> results;
+
+    for (auto &it:classes) {
+        results.push_back(make_pair(ceil(100 * float(it.second) / total), it.first));
+    }
+
+    std::sort(results.begin(), results.end(),
+            [](const pair_type &p1, const pair_type & p2)
+                //sort in reverse order
+                { return p1.first > p2.first; });
+
+    for (auto &it:results) {
+        out<<std::setw(4)<<it.first<<"% "<<it.second<<"."<<std::endl;
+    }
+}
+
+// The number of inputs in each class, and in all.
+struct ClassCounts
+{
+    std::map<std::string, size_t> classes;
+    size_t total;
+
+    ClassCounts():total(0) {}
+
+    void add(const std::string & label) {
+        ++classes[label];
+        ++total;
+    }
+
+    // Adds the counts of other classes, e.g. of another process.
+    void add(const std::map<std::string, size_t> & other) {
+        for (auto &it:other) {
+            classes[it.first] += it.second;
+            total += it.second;
+        }
+    }
+};
+
+// A coverage requirement, see Property::Cover: at least percent % of the
+// inputs should be in the class label.
+struct CoverRequirement
+{
+    std::string label;
+    double percent;
+};
+
+enum CoverStatus { COVER_UNDECIDED, COVER_MET, COVER_INSUFFICIENT };
+
+// How many standard deviations the Wilson bounds are away from the
+// proportion (a one-sided error of about 1e-9). The coverage is looked at
+// again and again as the tests run, so every look must be very unlikely
+// to be wrong.
+static const double COVER_Z = 6.0;
+
+// Coverage within this fraction of the required one is taken as met, so
+// that a requirement that holds exactly can be confirmed at all.
+static const double COVER_TOLERANCE = 0.9;
+
+// The Wilson score interval of the proportion k / n, z standard
+// deviations wide.
+inline std::pair<double, double> wilson_bounds(size_t k, size_t n, double z)
+{
+    if (n == 0) {
+        return std::make_pair(0.0, 1.0);
+    }
+    double p = double(k) / n, z2 = z * z / n;
+    double center = (p + z2 / 2) / (1 + z2);
+    double half = z * std::sqrt(p * (1 - p) / n + z2 / (4 * n)) / (1 + z2);
+    return std::make_pair(std::max(0.0, center - half), std::min(1.0, center + half));
+}
+
+// Decides the coverage requirement req, given the counts of the classes
+// of total inputs: met if the proportion is surely above (the tolerance
+// of) the required one, insufficient if it is surely below. Once the
+// tests are over (final), undecided requirements are judged by the
+// proportion observed.
+inline CoverStatus cover_status(const CoverRequirement & req,
+        const std::map<std::string, size_t> & classes, size_t total, bool final)
+{
+    auto it = classes.find(req.label);
+    size_t k = it == classes.end() ? 0 : it->second;
+    double required = req.percent / 100;
+    std::pair<double, double> bounds = wilson_bounds(k, total, COVER_Z);
+    if (bounds.first >= COVER_TOLERANCE * required) {
+        return COVER_MET;
+    }
+    if (bounds.second < required) {
+        return COVER_INSUFFICIENT;
+    }
+    if (final) {
+        return total && double(k) / total >= required ? COVER_MET : COVER_INSUFFICIENT;
+    }
+    return COVER_UNDECIDED;
+}
+
+// The status of all the requirements: met if they all are, insufficient
+// if any is.
+inline CoverStatus cover_status(const std::vector<CoverRequirement> & reqs,
+        const std::map<std::string, size_t> & classes, size_t total, bool final)
+{
+    CoverStatus all = COVER_MET;
+    for (auto &req:reqs) {
+        CoverStatus status = cover_status(req, classes, total, final);
+        if (status == COVER_INSUFFICIENT) {
+            return COVER_INSUFFICIENT;
+        }
+        if (status == COVER_UNDECIDED) {
+            all = COVER_UNDECIDED;
+        }
+    }
+    return all;
+}
+
+inline void print_coverage(std::ostream & out, const std::vector<CoverRequirement> & reqs,
+        const std::map<std::string, size_t> & classes, size_t total)
+{
+    for (auto &req:reqs) {
+        auto it = classes.find(req.label);
+        size_t k = it == classes.end() ? 0 : it->second;
+        out<<"  coverage of "<<req.label<<": "
+            <<(total ? std::floor(1000.0 * k / total) / 10 : 0)<<"%, required "
+            <<req.percent<<"%, "
+            <<(cover_status(req, classes, total, true) == COVER_MET ? "met." : "insufficient.")
+            <<std::endl;
+    }
+}
+
+// Checks the coverage requirements on the classes, see Property::Cover.
+// Only synchronous properties that run in one process stop early.
+struct CoverExtension : Extension
+{
+    std::vector<CoverRequirement> requirements;
+
+    // Whether the last run may stop early and whether it did, and the
+    // classes it was judged by.
+    bool early_stop;
+    bool stopped_early;
+    RunCounts counts;
+
+    CoverExtension():early_stop(false), stopped_early(false), counts() {}
+
+    // The copy has yet to run, and so has no classes.
+    std::unique_ptr<Extension> clone() const override {
+        std::unique_ptr<CoverExtension> copy = std::make_unique<CoverExtension>(*this);
+        copy->stopped_early = false;
+        copy->counts = RunCounts();
+        return copy;
+    }
+
+    bool prefers_one_process() const override {
+        return true;
+    }
+
+    void begin_run(const std::string &, bool async, bool sharded, bool classified) override {
+        if (!classified) {
+            std::cerr<<"Test error: ";
+            std::cerr<<"Cover needs a classifier, see Classify."<<std::endl;
+            exit(1);
+        }
+        early_stop = !async && !sharded;
+        stopped_early = false;
+        counts = RunCounts();
+    }
+
+    static void insufficient(const RunCounts & counts, RunFailure & failure) {
+        failure.title = "Insufficient coverage";
+        failure.detail = "after " + std::to_string(counts.tests) + " tests.";
+    }
+
+    CheckResult check(const RunCounts & counts, RunFailure & failure) override {
+        if (!early_stop) {
+            return CHECK_UNDECIDED;
+        }
+        this->counts = counts;
+        CoverStatus status = cover_status(requirements, *counts.classes,
+                counts.classified, false);
+        if (status == COVER_MET) {
+            stopped_early = true;
+            return CHECK_PASSED;
+        }
+        if (status == COVER_INSUFFICIENT) {
+            insufficient(counts, failure);
+            return CHECK_FAILED;
+        }
+        return CHECK_UNDECIDED;
+    }
+
+    bool end_run(const RunCounts & counts, RunFailure & failure) override {
+        this->counts = counts;
+        if (!stopped_early && cover_status(requirements, *counts.classes,
+                    counts.classified, true) == COVER_INSUFFICIENT) {
+            insufficient(counts, failure);
+            return false;
+        }
+        return true;
+    }
+
+    void print_results(std::ostream & out) const override {
+        if (counts.classes) {
+            print_coverage(out, requirements, *counts.classes, counts.classified);
+        }
+        if (stopped_early) {
+            out<<"  stopped early, the coverage was confirmed."<<std::endl;
+        }
+    }
+};
+
+} // namespace detail
 
 template<typename...Args>
 class Classifier
@@ -19,15 +242,14 @@ public:
     typedef std::function<std::string(Args&...)> classifier_type;
 private:
     classifier_type m_classifier_fun;
-    size_t m_total;
-    std::map<std::string, size_t> m_classes;
+    detail::ClassCounts m_counts;
 
 public:
 
     Classifier():Classifier(nullptr) {}
 
     Classifier(const classifier_type & classifier_fun):
-        m_classifier_fun(classifier_fun), m_total(0)
+        m_classifier_fun(classifier_fun)
     {}
 
     Classifier<Args...> & operator=(const classifier_type & classifier_fun) {
@@ -39,33 +261,38 @@ public:
         return m_classifier_fun != nullptr;
     }
 
-    // Classifies the given input using the classfier function.
-    void classify(std::tuple<Args...>& data) {
-        std::string _class = utils::apply_func<sizeof...(Args)>::apply(
-                m_classifier_fun, data);
-        ++m_classes[_class];
-        ++m_total;
+    // Classifies the given input using the classfier function
+    // and returns its class.
+    std::string classify(std::tuple<Args...>& data) {
+        std::string _class = utils::apply_func(m_classifier_fun, data);
+        m_counts.add(_class);
+        return _class;
     }
 
-    // Calculates the frequencies of the classes collected so far
-    // and prints the results to out.
-    void print_results(std::ostream& out = std::cout) {
+    // The number of inputs classified so far.
+    size_t total() const {
+        return m_counts.total;
+    }
 
-        typedef std::pair<size_t, std::string> pair_type;
-        std::vector<pair_type> results;
+    // The number of inputs in each class so far.
+    const std::map<std::string, size_t> & classes() const {
+        return m_counts.classes;
+    }
 
-        for (auto &it:m_classes) {
-            results.push_back(make_pair(ceil(100 * float(it.second) / m_total), it.first));
-        }
+    // The counts of the classes so far, which can be added to, e.g. those
+    // of another process.
+    detail::ClassCounts & counts() {
+        return m_counts;
+    }
 
-        std::sort(results.begin(), results.end(),
-                [](const pair_type &p1, const pair_type & p2)
-                    //sort in reverse order
-                    { return p1.first > p2.first; });
+    void add(const std::map<std::string, size_t> & classes) {
+        m_counts.add(classes);
+    }
 
-        for (auto &it:results) {
-            out<<std::setw(4)<<it.first<<"% "<<it.second<<"."<<std::endl;
-        }
+    // Calculates the frequencies of the classes collected so far
+    // and prints the results to out.
+    void print_results(std::ostream& out = std::cout) {
+        detail::print_classes(out, m_counts.classes, m_counts.total);
     }
 };
 
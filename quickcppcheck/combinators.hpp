@@ -0,0 +1,263 @@
+// Generator combinators for qcppc.
+//
+// Derive new generators from existing ones without wrapping every level
+// in an std::function: every expression has its own concrete type, so
+// that the compiler can inline the whole of e.g.
+//
+//     gen::map(gen::filter(Arbitrary<int>(0, 100), even), square)
+//
+// into a single sampling routine. The result is a generator like any
+// other and can be passed to Rnd<N>. Combinators of generators with
+// finite domains (see Generator) keep a finite domain where possible,
+// so they can still be enumerated in exhaustive mode.
+
+#ifndef QCPPC_COMBINATORS_H_
+#define QCPPC_COMBINATORS_H_
+
+#include <iostream>
+#include <tuple>
+#include <utility>
+#include <random>
+#include <type_traits>
+#include <cstdlib>
+
+#include "utils.hpp"
+#include "generator.hpp"
+
+namespace qcppc {
+namespace gen {
+
+// The type of the values of generator G.
+template<typename G>
+using value_t = typename std::decay<decltype(std::declval<G&>()())>::type;
+
+//--------------------------------------------------------------
+// map(g, f): f applied to the values of g.
+template<typename G, typename F, bool = utils::has_domain<G>::value>
+struct Map
+{
+    G g;
+    F f;
+
+    Map(const G & g, const F & f):g(g), f(f) {}
+
+    auto operator()() {
+        return f(g());
+    }
+};
+
+template<typename G, typename F>
+struct Map<G, F, true> : Map<G, F, false>
+{
+    using Map<G, F, false>::Map;
+
+    size_t domain_size() const {
+        return this->g.domain_size();
+    }
+
+    auto at(size_t i) const {
+        return this->f(this->g.at(i));
+    }
+};
+
+template<typename G, typename F>
+Map<G, F> map(const G & g, const F & f)
+{
+    return Map<G, F>(g, f);
+}
+
+//--------------------------------------------------------------
+// filter(g, pred): the values of g that satisfy pred. Unlike If, it
+// doesn't discard whole tests, only draws again. Since the filtered
+// domain isn't known without trying all its values, it is not finite.
+template<typename G, typename P>
+struct Filter
+{
+    G g;
+    P pred;
+
+    // Give up after that many values in a row don't satisfy pred.
+    static const unsigned int MAX_TRIES = 10000;
+
+    Filter(const G & g, const P & pred):g(g), pred(pred) {}
+
+    value_t<G> operator()() {
+        for (unsigned int i = 0;i < MAX_TRIES;++i) {
+            value_t<G> v = g();
+            if (pred(v)) {
+                return v;
+            }
+        }
+        std::cerr<<"Test error: ";
+        std::cerr<<"filter rejected "<<MAX_TRIES<<" values in a row."<<std::endl;
+        exit(1);
+    }
+};
+
+template<typename G, typename P>
+Filter<G, P> filter(const G & g, const P & pred)
+{
+    return Filter<G, P>(g, pred);
+}
+
+//--------------------------------------------------------------
+// bind(g, f): draws a value from g, then a value from the generator
+// f returns for it. For values that depend on each other, e.g. a size
+// and then a vector of that size.
+template<typename G, typename F>
+struct Bind
+{
+    G g;
+    F f;
+
+    Bind(const G & g, const F & f):g(g), f(f) {}
+
+    auto operator()() {
+        auto next = f(g());
+        return next();
+    }
+};
+
+template<typename G, typename F>
+Bind<G, F> bind(const G & g, const F & f)
+{
+    return Bind<G, F>(g, f);
+}
+
+//--------------------------------------------------------------
+// zip(g...): tuples of the values of all the gs. Its domain is the
+// product of theirs, if they all have one.
+template<bool Finite, typename... Gs>
+struct ZipImpl
+{
+    std::tuple<Gs...> gs;
+
+    ZipImpl(const Gs &... gs):gs(gs...) {}
+
+    std::tuple<value_t<Gs>...> operator()() {
+        // Braced initialization evaluates left to right.
+        return std::apply([](Gs &... g) {
+                    return std::tuple<value_t<Gs>...>{g()...};
+                }, gs);
+    }
+};
+
+template<typename... Gs>
+struct ZipImpl<true, Gs...> : ZipImpl<false, Gs...>
+{
+    using ZipImpl<false, Gs...>::ZipImpl;
+
+    // 0, i.e. unknown, if the product doesn't fit.
+    size_t domain_size() const {
+        return std::apply([](const Gs &... g) {
+                    size_t n = 1;
+                    bool fits = true;
+                    ((fits = fits && g.domain_size() != 0 &&
+                        n <= size_t(-1) / g.domain_size(),
+                      n *= g.domain_size()), ...);
+                    return fits ? n : 0;
+                }, this->gs);
+    }
+
+    // The first generator varies fastest.
+    std::tuple<value_t<Gs>...> at(size_t i) const {
+        return std::apply([i](const Gs &... g) mutable {
+                    return std::tuple<value_t<Gs>...>{
+                        next_at(g, i)...};
+                }, this->gs);
+    }
+
+private:
+    template<typename G>
+    static value_t<G> next_at(const G & g, size_t & i) {
+        size_t n = g.domain_size();
+        size_t k = i % n;
+        i /= n;
+        return g.at(k);
+    }
+};
+
+template<typename... Gs>
+using Zip = ZipImpl<(utils::has_domain<Gs>::value && ... && true), Gs...>;
+
+template<typename... Gs>
+Zip<Gs...> zip(const Gs &... gs)
+{
+    return Zip<Gs...>(gs...);
+}
+
+//--------------------------------------------------------------
+// oneof(g...): a value of one of the gs, chosen with equal probability.
+// All of them must produce the same type. Its domain is the union of
+// theirs (counting duplicates), if they all have one.
+template<bool Finite, typename G, typename... Gs>
+struct OneOfImpl : ArbitraryBase
+{
+    std::tuple<G, Gs...> gs;
+    std::uniform_int_distribution<size_t> dist;
+
+    static_assert((std::is_same<value_t<G>, value_t<Gs>>::value && ... && true),
+            "oneof: all the generators must produce the same type");
+
+    OneOfImpl(const G & g, const Gs &... gs):gs(g, gs...), dist(0, sizeof...(Gs)) {}
+
+    value_t<G> operator()() {
+        return call(dist(engine), std::index_sequence_for<G, Gs...>());
+    }
+
+private:
+    template<size_t... I>
+    value_t<G> call(size_t which, std::index_sequence<I...>) {
+        value_t<G> v{};
+        ((which == I && (v = std::get<I>(gs)(), true)) || ...);
+        return v;
+    }
+};
+
+template<typename G, typename... Gs>
+struct OneOfImpl<true, G, Gs...> : OneOfImpl<false, G, Gs...>
+{
+    using OneOfImpl<false, G, Gs...>::OneOfImpl;
+
+    // Not enumerable (0) if one of the generators isn't, or if the sum
+    // overflows.
+    size_t domain_size() const {
+        return std::apply([](const auto &... g) {
+                    size_t n = 0;
+                    bool fits = true;
+                    ((fits = fits && g.domain_size() != 0 &&
+                        n <= size_t(-1) - g.domain_size(),
+                      n += g.domain_size()), ...);
+                    return fits ? n : 0;
+                }, this->gs);
+    }
+
+    value_t<G> at(size_t i) const {
+        return at(i, std::index_sequence_for<G, Gs...>());
+    }
+
+private:
+    template<size_t... I>
+    value_t<G> at(size_t i, std::index_sequence<I...>) const {
+        value_t<G> v{};
+        ((i < std::get<I>(this->gs).domain_size() ?
+            (v = std::get<I>(this->gs).at(i), true) :
+            (i -= std::get<I>(this->gs).domain_size(), false)) || ...);
+        return v;
+    }
+};
+
+template<typename G, typename... Gs>
+using OneOf = OneOfImpl<(utils::has_domain<G>::value && ... &&
+        utils::has_domain<Gs>::value), G, Gs...>;
+
+template<typename G, typename... Gs>
+OneOf<G, Gs...> oneof(const G & g, const Gs &... gs)
+{
+    return OneOf<G, Gs...>(g, gs...);
+}
+
+} // namespace gen
+} // namespace qcppc
+
+#endif // QCPPC_COMBINATORS_H_
@@ -0,0 +1,275 @@
+// Complexity properties for qcppc.
+//
+// A complexity property times a function over generated inputs of growing
+// size, fits the measurements against a handful of complexity classes and
+// fails when the observed class is worse than the declared one.
+
+#ifndef QCPPC_COMPLEXITY_H_
+#define QCPPC_COMPLEXITY_H_
+
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <iomanip>
+#include <cmath>
+
+#include "property.hpp"
+
+namespace qcppc {
+
+// Complexity classes, ordered from the cheapest to the most expensive.
+enum class Order {
+    O_1,
+    O_LOG_N,
+    O_N,
+    O_N_LOG_N,
+    O_N2,
+};
+
+namespace detail {
+
+static const Order ALL_ORDERS[] = {
+    Order::O_1, Order::O_LOG_N, Order::O_N, Order::O_N_LOG_N, Order::O_N2
+};
+
+inline const char * order_name(Order o)
+{
+    switch (o) {
+        case Order::O_1: return "O(1)";
+        case Order::O_LOG_N: return "O(log n)";
+        case Order::O_N: return "O(n)";
+        case Order::O_N_LOG_N: return "O(n log n)";
+        case Order::O_N2: return "O(n^2)";
+    }
+    return "O(?)";
+}
+
+// The growth function of complexity class o, evaluated at n.
+inline double order_fun(Order o, double n)
+{
+    switch (o) {
+        case Order::O_1: return 1.0;
+        case Order::O_LOG_N: return std::log2(n);
+        case Order::O_N: return n;
+        case Order::O_N_LOG_N: return n * std::log2(n);
+        case Order::O_N2: return n * n;
+    }
+    return 1.0;
+}
+
+inline double median(std::vector<double> v)
+{
+    assert(!v.empty());
+    std::sort(v.begin(), v.end());
+    size_t h = v.size() / 2;
+    return v.size() % 2 ? v[h] : (v[h - 1] + v[h]) / 2;
+}
+
+// Fits t = c * g(n) in log space: c is the median of log(t / g(n)) and the
+// error is the median absolute deviation from it. Medians ignore outliers
+// that a least squares fit would chase, and working with ratios makes the
+// errors of different classes comparable independently of the time scale.
+inline double fit_order(Order o, const std::vector<double> & ns,
+        const std::vector<double> & ts)
+{
+    std::vector<double> logs;
+    for (size_t i = 0;i < ns.size();++i) {
+        logs.push_back(std::log(ts[i] / order_fun(o, ns[i])));
+    }
+    double c = median(logs);
+
+    std::vector<double> residuals;
+    for (auto l:logs) residuals.push_back(std::fabs(l - c));
+    return median(residuals);
+}
+
+} // namespace detail
+
+// An object of class Complexity times a function over inputs of growing
+// size and checks that it scales no worse than a declared complexity class.
+template<typename Input>
+class Complexity
+{
+private:
+    typedef std::function<void(Input&)> FunType;
+    typedef std::function<Input(size_t)> GenType;
+    typedef std::chrono::steady_clock Clock;
+
+    // The function to time.
+    FunType fun;
+
+    // Generates an input of the given size. Generation is never timed.
+    GenType gen;
+
+    // The complexity class the function should not exceed.
+    Order declared;
+
+    // Description of the property.
+    std::string name;
+
+    // Output verbosity level.
+    int verbose;
+
+    // Number of timed samples per input size. The median is used.
+    unsigned int samples;
+
+    // Number of calls on the same input per sample.
+    unsigned int reps;
+
+    // Default number of samples per input size.
+    static constexpr unsigned int SAMPLES = 7;
+
+    // A cheaper class is preferred over the best fitting one as long as its
+    // fit error is within this factor (plus SLACK) of the best error.
+    // This keeps noisy measurements from turning into failures.
+    static constexpr double TOLERANCE = 1.5;
+    static constexpr double SLACK = 0.02;
+
+    // Default generator: an Arbitrary<Input> producing values of size n.
+    template<typename T = Input>
+    static typename std::enable_if<
+            std::is_constructible<Arbitrary<T>, size_t, size_t>::value,
+            GenType>::type
+    default_gen()
+    {
+        return [](size_t n) { return Arbitrary<T>(n, n)(); };
+    }
+
+    template<typename T = Input>
+    static typename std::enable_if<
+            !std::is_constructible<Arbitrary<T>, size_t, size_t>::value,
+            GenType>::type
+    default_gen()
+    {
+        return [](size_t) { return Arbitrary<T>()(); };
+    }
+
+    // Times a single sample on a freshly generated input of size n.
+    double sample(size_t n)
+    {
+        Input input = gen(n);
+        auto start = Clock::now();
+        for (unsigned int r = 0;r < reps;++r) {
+            fun(input);
+        }
+        auto end = Clock::now();
+        return std::chrono::duration<double>(end - start).count() / reps;
+    }
+
+public:
+    // Constructs a Complexity object around the function fun.
+    //
+    // Arguments:
+    //
+    // fun: the function to time; it gets a generated input by reference.
+    //
+    // declared: the complexity class that fun should not exceed.
+    //
+    // name, verbose: as for class Property. With verbose=2 the measured
+    //  times and the fit errors of all classes are printed as well.
+    Complexity(const FunType & fun, Order declared, const std::string & name =
+            std::string("<unnamed>"), int verbose = 1):
+        fun(fun), gen(default_gen()), declared(declared), name(name),
+        verbose(verbose), samples(SAMPLES), reps(1)
+    {}
+
+    // Measures fun for sizes min_n, 2*min_n, ... up to max_n and
+    // checks the observed complexity class against the declared one.
+    bool operator()(size_t min_n = 1 << 8, size_t max_n = 1 << 16)
+    {
+        std::ostream & out = detail::output();
+        assert(min_n > 1 && min_n < max_n);
+
+        if (verbose > 0) {
+            out<<"Property: "<<MAKE_YELLOW(name)<<std::endl;
+        }
+
+        std::vector<double> ns, ts;
+        for (size_t n = min_n;n <= max_n;n *= 2) {
+            std::vector<double> times;
+            for (unsigned int s = 0;s < samples;++s) {
+                times.push_back(sample(n));
+            }
+            ns.push_back(n);
+            ts.push_back(std::max(detail::median(times), 1e-12));
+            if (verbose > 1) {
+                out<<std::setw(10)<<n<<" "<<std::setw(12)<<ts.back()<<"s"<<std::endl;
+            }
+        }
+
+        std::vector<double> errors;
+        size_t best = 0;
+        for (size_t i = 0;i < sizeof(detail::ALL_ORDERS) / sizeof(Order);++i) {
+            errors.push_back(detail::fit_order(detail::ALL_ORDERS[i], ns, ts));
+            if (errors[i] < errors[best]) best = i;
+            if (verbose > 1) {
+                out<<std::setw(12)<<detail::order_name(detail::ALL_ORDERS[i])
+                    <<" fit error "<<errors[i]<<std::endl;
+            }
+        }
+
+        size_t observed = best;
+        for (size_t i = 0;i < best;++i) {
+            if (errors[i] <= errors[best] * TOLERANCE + SLACK) {
+                observed = i;
+                break;
+            }
+        }
+
+        Order o = detail::ALL_ORDERS[observed];
+        bool ok = o <= declared;
+        if (verbose > 0) {
+            if (ok) {
+                out<<MAKE_GREEN("+++ OK,")<<" observed "<<detail::order_name(o)
+                    <<", declared "<<detail::order_name(declared)<<"."<<std::endl;
+            } else {
+                out<<MAKE_RED("*** Too slow,")<<" observed "<<detail::order_name(o)
+                    <<", declared "<<detail::order_name(declared)<<"."<<std::endl;
+            }
+            out<<std::endl;
+        }
+        return ok;
+    }
+
+    // Sets the generator for inputs of a given size.
+    Complexity<Input> & Gen(const GenType & gen)
+    {
+        this->gen = gen;
+        return *this;
+    }
+
+    // Sets the number of timed samples per input size.
+    Complexity<Input> & Samples(unsigned int samples)
+    {
+        assert(samples > 0);
+        this->samples = samples;
+        return *this;
+    }
+
+    // Calls fun reps times on the same input for every sample, so that
+    // very cheap functions can be timed above the clock resolution.
+    // fun should leave its input in an equivalent state when reps > 1.
+    Complexity<Input> & Reps(unsigned int reps)
+    {
+        assert(reps > 0);
+        this->reps = reps;
+        return *this;
+    }
+};
+
+// Helper function to create objects of Complexity class.
+// Extracts the input type from the single argument of the function.
+template<typename T, typename...Params,
+    typename Input = typename std::decay<typename std::tuple_element<0,
+            typename function_traits<T>::arg_types>::type>::type>
+Complexity<Input> complexity(const T & t, Order declared, Params...params)
+{
+    return Complexity<Input>(t, declared, std::forward<Params>(params)...);
+}
+
+} // namespace qcppc
+
+#endif // QCPPC_COMPLEXITY_H_
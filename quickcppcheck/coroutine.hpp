@@ -0,0 +1,165 @@
+// Coroutine generators for qcppc (C++20).
+//
+// A generator can be written as a coroutine that co_yields its values one
+// after another, keeping its state in local variables instead of a
+// hand-written state machine:
+//
+//     auto increasing = []() -> qcppc::Coroutine<int> {
+//         qcppc::Arbitrary<int> step(1, 10);
+//         for (int k = 0;;) co_yield k += step();
+//     };
+//
+//     qcppc::property(...)
+//         .Rnd<0>(qcppc::gen::coroutine(increasing))
+//         ();
+//
+// Every test takes the next value. A coroutine that ends starts over.
+// The frames come from the pool of the property that runs them (see
+// pool.hpp).
+
+#ifndef QCPPC_COROUTINE_H_
+#define QCPPC_COROUTINE_H_
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define QCPPC_HAS_COROUTINES 1
+
+#include <coroutine>
+#include <optional>
+#include <iostream>
+#include <cstdlib>
+#include <new>
+
+#include "pool.hpp"
+
+namespace qcppc {
+
+// The return type of coroutine generators of values of type T.
+template<typename T>
+class Coroutine
+{
+public:
+    struct promise_type
+    {
+        std::optional<T> value;
+
+        Coroutine get_return_object() {
+            return Coroutine(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        std::suspend_always yield_value(T v) {
+            value = std::move(v);
+            return {};
+        }
+
+        void return_void() {}
+
+        void unhandled_exception() { throw; }
+
+        // Frames start with the pool they were taken from, if any.
+        static const size_t HEADER = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+        static void * operator new(size_t n) {
+            detail::FramePool * pool = detail::current_frame_pool();
+            char * p = static_cast<char*>(pool ? pool->allocate(n + HEADER) :
+                    ::operator new(n + HEADER));
+            *reinterpret_cast<detail::FramePool**>(p) = pool;
+            return p + HEADER;
+        }
+
+        static void operator delete(void * frame, size_t n) {
+            char * p = static_cast<char*>(frame) - HEADER;
+            detail::FramePool * pool = *reinterpret_cast<detail::FramePool**>(p);
+            if (pool) {
+                pool->deallocate(p, n + HEADER);
+            } else {
+                ::operator delete(p);
+            }
+        }
+    };
+
+    Coroutine(Coroutine && other) noexcept:handle(other.handle) {
+        other.handle = nullptr;
+    }
+
+    Coroutine & operator=(Coroutine && other) noexcept {
+        std::swap(handle, other.handle);
+        return *this;
+    }
+
+    ~Coroutine() {
+        if (handle) handle.destroy();
+    }
+
+    // Runs up to the next co_yield. Returns false if the coroutine ended
+    // instead.
+    bool resume() {
+        handle.promise().value.reset();
+        handle.resume();
+        return !handle.done();
+    }
+
+    // The last value yielded.
+    T & value() {
+        return *handle.promise().value;
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Coroutine(std::coroutine_handle<promise_type> handle):handle(handle) {}
+};
+
+namespace gen {
+
+// A generator taking its values from the coroutines that factory returns,
+// one after another. Copies start their own coroutines.
+template<typename F>
+struct CoroutineGen
+{
+    typedef typename std::decay<decltype(std::declval<F&>()().value())>::type value_type;
+    typedef void uses_frame_pool;
+
+    F factory;
+    std::optional<Coroutine<value_type>> co;
+
+    CoroutineGen(const F & factory):factory(factory) {}
+
+    CoroutineGen(const CoroutineGen & other):factory(other.factory) {}
+
+    CoroutineGen & operator=(const CoroutineGen & other) {
+        factory = other.factory;
+        co.reset();
+        return *this;
+    }
+
+    value_type operator()() {
+        if (!co || !co->resume()) {
+            // The coroutine ended (or never started), start over.
+            co.reset();
+            co.emplace(factory());
+            if (!co->resume()) {
+                std::cerr<<"Test error: ";
+                std::cerr<<"coroutine generator yielded no values."<<std::endl;
+                exit(1);
+            }
+        }
+        return co->value();
+    }
+};
+
+// Creates a generator from a callable returning Coroutine<T>.
+template<typename F>
+CoroutineGen<F> coroutine(const F & factory)
+{
+    return CoroutineGen<F>(factory);
+}
+
+} // namespace gen
+} // namespace qcppc
+
+#endif // __cpp_impl_coroutine
+
+#endif // QCPPC_COROUTINE_H_
@@ -0,0 +1,458 @@
+// Goodness-of-fit checks for generators.
+//
+// A Distribution draws samples from a generator and tests them against
+// the distribution they should follow, with p-values:
+//
+//     qcppc::distribution(qcppc::Arbitrary<int>(0, 99), "Arbitrary<int> is uniform")
+//         .Uniform(0, 99)           // chi-square for integers, KS for reals
+//         .SerialCorrelation()      // consecutive samples are independent
+//         ();
+//
+// The samples are streamed into the tests as they are drawn, so only the
+// Kolmogorov-Smirnov test keeps them. A few hundred thousand samples
+// find skews and correlations that means over millions miss.
+
+#ifndef QCPPC_DISTRIBUTION_H_
+#define QCPPC_DISTRIBUTION_H_
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <cmath>
+#include <cstdint>
+#include <cassert>
+
+#include "property.hpp"
+
+namespace qcppc {
+namespace detail {
+
+// The regularized upper incomplete gamma function Q(a, x), by its series
+// for x < a + 1 and by its continued fraction otherwise.
+inline double gamma_q(double a, double x)
+{
+    if (x <= 0) {
+        return 1;
+    }
+    double gln = std::lgamma(a);
+    if (x < a + 1) {
+        double ap = a, sum = 1 / a, del = sum;
+        for (int n = 0;n < 1000 && std::fabs(del) > std::fabs(sum) * 1e-15;++n) {
+            ap += 1;
+            del *= x / ap;
+            sum += del;
+        }
+        return 1 - sum * std::exp(-x + a * std::log(x) - gln);
+    }
+    const double tiny = 1e-300;
+    double b = x + 1 - a, c = 1 / tiny, d = 1 / b, h = d;
+    for (int i = 1;i < 1000;++i) {
+        double an = -i * (i - a);
+        b += 2;
+        d = an * d + b;
+        if (std::fabs(d) < tiny) d = tiny;
+        c = b + an / c;
+        if (std::fabs(c) < tiny) c = tiny;
+        d = 1 / d;
+        double del = d * c;
+        h *= del;
+        if (std::fabs(del - 1) < 1e-15) break;
+    }
+    return std::exp(-x + a * std::log(x) - gln) * h;
+}
+
+// The p-value of a chi-square statistic with df degrees of freedom.
+inline double chi_square_p(double stat, double df)
+{
+    return gamma_q(df / 2, stat / 2);
+}
+
+// The p-value of the Kolmogorov-Smirnov statistic d of n samples, with
+// the asymptotic distribution and Stephens' correction for small n.
+inline double ks_p(double d, size_t n)
+{
+    double sqrt_n = std::sqrt(double(n));
+    double lambda = (sqrt_n + 0.12 + 0.11 / sqrt_n) * d;
+    if (lambda < 0.3) {
+        return 1;
+    }
+    double p = 0, sign = 1;
+    for (int k = 1;k <= 100;++k) {
+        double term = std::exp(-2.0 * k * k * lambda * lambda);
+        p += sign * term;
+        sign = -sign;
+        if (term < 1e-16) break;
+    }
+    return std::min(1.0, std::max(0.0, 2 * p));
+}
+
+// Counts the samples falling in buckets, for a chi-square test against
+// the probabilities of the buckets.
+struct ChiSquareTest
+{
+    std::vector<double> probabilities;
+    std::vector<uint64_t> counts;
+    uint64_t outside;
+
+    ChiSquareTest(const std::vector<double> & probabilities):
+        probabilities(probabilities), counts(probabilities.size()), outside(0)
+    {}
+
+    void add(size_t bucket) {
+        if (bucket < counts.size()) {
+            ++counts[bucket];
+        } else {
+            ++outside;
+        }
+    }
+
+    double statistic(uint64_t n) const {
+        double stat = 0;
+        for (size_t b = 0;b < counts.size();++b) {
+            double expected = probabilities[b] * n;
+            if (expected > 0) {
+                double diff = counts[b] - expected;
+                stat += diff * diff / expected;
+            }
+        }
+        return stat;
+    }
+
+    // Samples outside the buckets fail the test.
+    double p(uint64_t n) const {
+        if (outside) {
+            return 0;
+        }
+        return chi_square_p(statistic(n), std::max<size_t>(1, counts.size() - 1));
+    }
+};
+
+// Keeps the samples for a Kolmogorov-Smirnov test against a continuous
+// cumulative distribution function.
+struct KSTest
+{
+    std::function<double(double)> cdf;
+    std::vector<double> values;
+
+    KSTest(const std::function<double(double)> & cdf):cdf(cdf) {}
+
+    void add(double x) {
+        values.push_back(x);
+    }
+
+    double statistic() {
+        std::sort(values.begin(), values.end());
+        double d = 0, n = values.size();
+        for (size_t i = 0;i < values.size();++i) {
+            double f = cdf(values[i]);
+            d = std::max(d, std::max(f - i / n, (i + 1) / n - f));
+        }
+        return d;
+    }
+};
+
+// The lag-1 autocorrelation of the samples. Samples are shifted by the
+// first one, so that large values don't lose precision.
+struct SerialTest
+{
+    uint64_t n;
+    double shift, previous, sum, sum_squares, sum_products;
+
+    SerialTest():n(0), shift(0), previous(0), sum(0), sum_squares(0), sum_products(0) {}
+
+    void add(double x) {
+        if (n == 0) {
+            shift = x;
+        }
+        x -= shift;
+        if (n > 0) {
+            sum_products += previous * x;
+        }
+        sum += x;
+        sum_squares += x * x;
+        previous = x;
+        ++n;
+    }
+
+    double correlation() const {
+        if (n < 3) {
+            return 0;
+        }
+        double mean = sum / n;
+        double var = sum_squares / n - mean * mean;
+        if (var <= 0) {
+            // Constant samples are as correlated as can be.
+            return 1;
+        }
+        return (sum_products / (n - 1) - mean * mean) / var;
+    }
+
+    // Two-sided, with r being about normal with mean -1/n and variance
+    // 1/n for independent samples.
+    double p() const {
+        double z = (correlation() + 1.0 / n) * std::sqrt(double(n));
+        return std::erfc(std::fabs(z) / std::sqrt(2.0));
+    }
+};
+
+// Prints the outcome of the checks of a distribution, tests being the
+// "name: details, p = ..." lines.
+inline void print_distribution_result(std::ostream & out, bool ok, uint64_t samples,
+        double alpha, const std::vector<std::string> & tests)
+{
+    if (ok) {
+        out<<MAKE_GREEN("+++ OK,")<<" passed "<<tests.size()<<" tests on "
+            <<samples<<" samples."<<std::endl;
+    } else {
+        out<<MAKE_RED("*** Falsifiable,")<<" the samples are unlikely (p < "
+            <<alpha<<") after "<<samples<<" samples."<<std::endl;
+    }
+    for (auto &t:tests) {
+        out<<"  "<<t<<std::endl;
+    }
+}
+
+} // namespace detail
+
+// An object of class Distribution draws samples from a generator and
+// checks them against the distribution they should follow.
+template<typename T>
+class Distribution
+{
+private:
+    typedef std::function<T()> GenType;
+    typedef std::function<size_t(const T&)> BucketType;
+    typedef std::function<double(double)> CdfType;
+
+    // The generator to check.
+    GenType gen;
+
+    // Description of the property.
+    std::string name;
+
+    // Output verbosity level.
+    int verbose;
+
+    // Number of samples.
+    uint64_t samples;
+
+    // The checks fail below this p-value.
+    double alpha;
+
+    // The chi-square test, if any: the bucket of every sample and the
+    // probabilities of the buckets.
+    BucketType bucket;
+    std::vector<double> probabilities;
+
+    // The cumulative distribution function for the Kolmogorov-Smirnov
+    // test, if any.
+    CdfType cdf;
+
+    bool serial;
+
+    // Default number of samples.
+    static constexpr uint64_t SAMPLES = 100000;
+
+    // Default significance level. It is low, since a generator is usually
+    // checked many times, and real defects give far lower p-values.
+    static constexpr double ALPHA = 1e-4;
+
+    // Integer ranges get one bucket per value up to this many values, and
+    // this many equal buckets beyond.
+    static constexpr size_t MAX_BUCKETS = 1000;
+
+    template<typename U = T>
+    typename std::enable_if<std::is_integral<U>::value>::type
+    uniform(U low, U high)
+    {
+        typedef typename std::make_unsigned<U>::type UType;
+        // The number of values, 0 if it is all of them (2^64).
+        uint64_t range = uint64_t(UType(UType(high) - UType(low))) + 1;
+        size_t nbuckets = range && range <= MAX_BUCKETS ? size_t(range) : MAX_BUCKETS;
+        // Exact integer arithmetic as long as it fits in 64 bits.
+        bool exact = range && range < (uint64_t(1) << 40);
+        bucket = [low, range, nbuckets, exact](const T & x) -> size_t {
+            uint64_t off = uint64_t(UType(UType(x) - UType(low)));
+            if (range && off >= range) {
+                return nbuckets;
+            }
+            if (exact) {
+                return size_t(off * nbuckets / range);
+            }
+            long double size = range ? (long double)range : 18446744073709551616.0L;
+            return std::min(nbuckets - 1, size_t(off / size * nbuckets));
+        };
+        probabilities.clear();
+        for (size_t b = 0;b < nbuckets;++b) {
+            if (exact) {
+                // The values v with v * nbuckets / range == b.
+                uint64_t first = (b * range + nbuckets - 1) / nbuckets;
+                uint64_t last = ((b + 1) * range + nbuckets - 1) / nbuckets;
+                probabilities.push_back(double(last - first) / range);
+            } else {
+                probabilities.push_back(1.0 / nbuckets);
+            }
+        }
+    }
+
+    template<typename U = T>
+    typename std::enable_if<std::is_floating_point<U>::value>::type
+    uniform(U low, U high)
+    {
+        double lo = low, hi = high;
+        cdf = [lo, hi](double x) { return std::min(1.0, std::max(0.0, (x - lo) / (hi - lo))); };
+    }
+
+    template<typename U = T>
+    static typename std::enable_if<std::is_arithmetic<U>::value, double>::type
+    to_double(const U & x)
+    {
+        return double(x);
+    }
+
+    template<typename U = T>
+    static typename std::enable_if<!std::is_arithmetic<U>::value, double>::type
+    to_double(const U &)
+    {
+        return 0;
+    }
+
+public:
+    // Constructs a Distribution object around the generator gen.
+    //
+    // name, verbose: as for class Property.
+    Distribution(const GenType & gen, const std::string & name =
+            std::string("<unnamed>"), int verbose = 1):
+        gen(gen), name(name), verbose(verbose), samples(SAMPLES), alpha(ALPHA),
+        bucket(nullptr), cdf(nullptr), serial(false)
+    {}
+
+    // Draws the samples and runs the tests.
+    bool operator()()
+    {
+        std::ostream & out = detail::output();
+        if (verbose > 0) {
+            out<<"Property: "<<MAKE_YELLOW(name)<<std::endl;
+        }
+
+        detail::ChiSquareTest chi(probabilities);
+        detail::KSTest ks(cdf);
+        detail::SerialTest ser;
+
+        for (uint64_t drawn = 0;drawn < samples;++drawn) {
+            T x = gen();
+            if (bucket) chi.add(bucket(x));
+            if (cdf) ks.add(to_double(x));
+            if (serial) ser.add(to_double(x));
+        }
+
+        bool ok = true;
+        std::vector<std::string> tests;
+        std::ostringstream line;
+        line<<std::setprecision(3);
+        if (bucket) {
+            double p = chi.p(samples);
+            ok &= p >= alpha;
+            line<<"chi-square: "<<chi.counts.size()<<" buckets";
+            if (chi.outside) {
+                line<<", "<<chi.outside<<" samples outside";
+            }
+            line<<", statistic "<<chi.statistic(samples)<<", p = "<<p<<".";
+            tests.push_back(line.str());
+            line.str("");
+        }
+        if (cdf) {
+            double d = ks.statistic(), p = detail::ks_p(d, samples);
+            ok &= p >= alpha;
+            line<<"Kolmogorov-Smirnov: D = "<<d<<", p = "<<p<<".";
+            tests.push_back(line.str());
+            line.str("");
+        }
+        if (serial) {
+            double p = ser.p();
+            ok &= p >= alpha;
+            line<<"serial correlation: r = "<<ser.correlation()<<", p = "<<p<<".";
+            tests.push_back(line.str());
+            line.str("");
+        }
+        if (verbose > 0) {
+            detail::print_distribution_result(out, ok, samples, alpha, tests);
+            out<<std::endl;
+        }
+        return ok;
+    }
+
+    // Sets the number of samples.
+    Distribution<T> & Samples(uint64_t samples)
+    {
+        assert(samples > 1);
+        this->samples = samples;
+        return *this;
+    }
+
+    // Sets the significance level of the tests.
+    Distribution<T> & Alpha(double alpha)
+    {
+        this->alpha = alpha;
+        return *this;
+    }
+
+    // Checks that the samples are uniform on [low, high]: with a
+    // chi-square test for integers (one bucket per value, or equal
+    // buckets for large ranges) and a Kolmogorov-Smirnov test for reals.
+    Distribution<T> & Uniform(T low, T high)
+    {
+        static_assert(std::is_arithmetic<T>::value, "Uniform: T is not arithmetic");
+        uniform(low, high);
+        return *this;
+    }
+
+    // Checks with a chi-square test that the samples fall in the buckets
+    // (numbered from 0) with the given probabilities. Samples in no
+    // bucket (bucket returns probabilities.size() or more) fail the test.
+    Distribution<T> & ChiSquare(const BucketType & bucket,
+            const std::vector<double> & probabilities)
+    {
+        this->bucket = bucket;
+        this->probabilities = probabilities;
+        return *this;
+    }
+
+    // Checks with a Kolmogorov-Smirnov test that the samples follow the
+    // continuous cumulative distribution function cdf.
+    Distribution<T> & KS(const CdfType & cdf)
+    {
+        static_assert(std::is_arithmetic<T>::value, "KS: T is not arithmetic");
+        this->cdf = cdf;
+        return *this;
+    }
+
+    // Checks that consecutive samples are uncorrelated (lag-1
+    // autocorrelation).
+    Distribution<T> & SerialCorrelation()
+    {
+        static_assert(std::is_arithmetic<T>::value,
+                "SerialCorrelation: T is not arithmetic");
+        serial = true;
+        return *this;
+    }
+};
+
+// Helper function to create objects of Distribution class.
+// Extracts the type of the samples from the generator.
+template<typename G, typename...Params,
+    typename T = typename std::decay<decltype(std::declval<G&>()())>::type>
+Distribution<T> distribution(const G & gen, Params...params)
+{
+    return Distribution<T>(gen, std::forward<Params>(params)...);
+}
+
+} // namespace qcppc
+
+#endif // QCPPC_DISTRIBUTION_H_
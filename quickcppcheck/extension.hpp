@@ -0,0 +1,176 @@
+// Extensions of properties for qcppc.
+//
+// The opt-in features that hook into the tests of a property (Cover,
+// Perf, Allocations and Baseline) are extensions: a property holds only
+// the ones it was asked for and calls them through the Extension
+// interface, so that plain properties neither run nor instantiate them.
+
+#ifndef QCPPC_EXTENSION_H_
+#define QCPPC_EXTENSION_H_
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <memory>
+
+namespace qcppc {
+namespace detail {
+
+// The input of the current test, as extensions see it.
+class TestInput
+{
+public:
+    virtual ~TestInput() {}
+
+    // The input as printed in the reports. Once destroyed, it is drawn
+    // again for that, if an extension redraws inputs (see
+    // Extension::redraws_input).
+    virtual std::string print() = 0;
+
+    // Destroys the input, except the held arguments (see Property::Fix).
+    virtual void destroy() = 0;
+};
+
+// The tests of a run so far, as extensions see them.
+struct RunCounts
+{
+    unsigned int tests;
+
+    // The number of inputs in each class (see Property::Classify), and of
+    // classified inputs.
+    const std::map<std::string, size_t> * classes;
+    size_t classified;
+};
+
+// Why an extension failed a run, reported as "*** title, detail".
+struct RunFailure
+{
+    std::string title;
+    std::string detail;
+};
+
+enum CheckResult { CHECK_UNDECIDED, CHECK_PASSED, CHECK_FAILED };
+
+class Extension
+{
+public:
+    virtual ~Extension() {}
+
+    // A copy for a copy of the property.
+    virtual std::unique_ptr<Extension> clone() const = 0;
+
+    // Whether the property should run in one process by default, as this
+    // extension is turned off or limited in shards (see Property::Shards).
+    virtual bool prefers_one_process() const { return false; }
+
+    // Whether the extension may print the input of a test after it
+    // destroyed it. The random engine is then kept as it was before each
+    // test, to draw the input again.
+    virtual bool redraws_input() const { return false; }
+
+    // Starts a run of the property name. async: it is asynchronous,
+    // sharded: its tests run in worker processes, classified: it has a
+    // classifier. Only synchronous tests call the hooks below, up to
+    // end_test, in the process that runs them.
+    virtual void begin_run(const std::string &, bool, bool, bool) {}
+
+    // Starts a test, before its input is drawn.
+    virtual void begin_test(TestInput &) {}
+
+    // Around every drawing of the input, and around the call of the
+    // property function with the input of class label.
+    virtual void begin_generation() {}
+    virtual void end_generation() {}
+    virtual void begin_call() {}
+    virtual void end_call(const std::string &) {}
+
+    // Ends a test that passed. Returns why it fails anyway, if it does.
+    virtual std::string end_test(TestInput &) { return std::string(); }
+
+    // Looks at the tests so far, every so many of them, if the run may
+    // stop early: CHECK_PASSED stops it as passed, CHECK_FAILED fails it
+    // with failure.
+    virtual CheckResult check(const RunCounts &, RunFailure &) { return CHECK_UNDECIDED; }
+
+    // Ends a run whose tests passed. Returns false, with failure, to fail
+    // it anyway.
+    virtual bool end_run(const RunCounts &, RunFailure &) { return true; }
+
+    // Prints what the extension found in the last run, in its report.
+    virtual void print_results(std::ostream &) const {}
+};
+
+// The extensions of a property, in the order they are called (and, after
+// the tests, in reverse order) and report.
+enum ExtensionSlot { COVER_EXTENSION, PERF_EXTENSION, ALLOC_EXTENSION,
+    BASELINE_EXTENSION, NUM_EXTENSIONS };
+
+// The extensions of a property, at most one in each slot. Copies of the
+// property get copies of them.
+class Extensions
+{
+private:
+    std::unique_ptr<Extension> slots[NUM_EXTENSIONS];
+
+public:
+    Extensions() {}
+
+    Extensions(const Extensions & other) {
+        *this = other;
+    }
+
+    Extensions(Extensions &&) = default;
+
+    Extensions & operator=(const Extensions & other) {
+        for (int s = 0;s < NUM_EXTENSIONS;++s) {
+            slots[s] = other.slots[s] ? other.slots[s]->clone() : nullptr;
+        }
+        return *this;
+    }
+
+    Extensions & operator=(Extensions &&) = default;
+
+    Extension * get(ExtensionSlot s) const {
+        return slots[s].get();
+    }
+
+    void set(ExtensionSlot s, std::unique_ptr<Extension> e) {
+        slots[s] = std::move(e);
+    }
+
+    // The extension in slot s, made as an E if there is none.
+    template<typename E>
+    E & get_or_make(ExtensionSlot s) {
+        if (!slots[s]) {
+            slots[s].reset(new E());
+        }
+        return static_cast<E &>(*slots[s]);
+    }
+
+    bool empty() const {
+        for (auto &e:slots) {
+            if (e) return false;
+        }
+        return true;
+    }
+
+    // Calls f on every extension, in order, or in reverse order.
+    template<typename F>
+    void each(F f) const {
+        for (auto &e:slots) {
+            if (e) f(*e);
+        }
+    }
+
+    template<typename F>
+    void each_reversed(F f) const {
+        for (int s = NUM_EXTENSIONS - 1;s >= 0;--s) {
+            if (slots[s]) f(*slots[s]);
+        }
+    }
+};
+
+} // namespace detail
+} // namespace qcppc
+
+#endif // QCPPC_EXTENSION_H_
@@ -0,0 +1,119 @@
+// A type-erased callable for qcppc.
+//
+// Like std::function, except that it also holds callables that can't be
+// copied, such as a lambda that owns an std::unique_ptr. The copies of a
+// Function copy its callable if they can, and share it otherwise.
+// Generators are kept in these (see Generator), so that they may own
+// move-only state as well as produce move-only values.
+
+#ifndef QCPPC_FUNCTION_H_
+#define QCPPC_FUNCTION_H_
+
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+
+namespace qcppc {
+namespace detail {
+
+template<typename Signature>
+class Function;
+
+template<typename R, typename... Args>
+class Function<R(Args...)>
+{
+private:
+    struct Callable
+    {
+        virtual ~Callable() {}
+        virtual R call(Args&&... args) = 0;
+        virtual Callable * clone() const = 0;
+    };
+
+    // A callable that is copied with the Function.
+    template<typename F>
+    struct Owned : Callable
+    {
+        F f;
+
+        template<typename G>
+        Owned(G && g):f(std::forward<G>(g)) {}
+
+        R call(Args&&... args) {
+            return f(std::forward<Args>(args)...);
+        }
+
+        Callable * clone() const {
+            return new Owned<F>(f);
+        }
+    };
+
+    // A callable that can't be copied, shared by the copies.
+    template<typename F>
+    struct Shared : Callable
+    {
+        std::shared_ptr<F> f;
+
+        Shared(const std::shared_ptr<F> & f):f(f) {}
+
+        R call(Args&&... args) {
+            return (*f)(std::forward<Args>(args)...);
+        }
+
+        Callable * clone() const {
+            return new Shared<F>(f);
+        }
+    };
+
+    template<typename F, typename G>
+    static typename std::enable_if<std::is_copy_constructible<F>::value, Callable*>::type
+    make(G && g) {
+        return new Owned<F>(std::forward<G>(g));
+    }
+
+    template<typename F, typename G>
+    static typename std::enable_if<!std::is_copy_constructible<F>::value, Callable*>::type
+    make(G && g) {
+        return new Shared<F>(std::make_shared<F>(std::forward<G>(g)));
+    }
+
+    std::unique_ptr<Callable> callable;
+
+public:
+    Function() {}
+
+    Function(std::nullptr_t) {}
+
+    Function(const Function & other):
+        callable(other.callable ? other.callable->clone() : nullptr)
+    {}
+
+    Function(Function && other) = default;
+
+    template<typename F, typename D = typename std::decay<F>::type,
+        typename Enable = typename std::enable_if<
+            !std::is_same<D, Function>::value &&
+            std::is_invocable_r<R, D&, Args...>::value>::type>
+    Function(F && f):callable(make<D>(std::forward<F>(f))) {}
+
+    Function & operator=(const Function & other) {
+        callable.reset(other.callable ? other.callable->clone() : nullptr);
+        return *this;
+    }
+
+    Function & operator=(Function && other) = default;
+
+    R operator()(Args... args) const {
+        return callable->call(std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const {
+        return callable != nullptr;
+    }
+};
+
+} // namespace detail
+} // namespace qcppc
+
+#endif // QCPPC_FUNCTION_H_
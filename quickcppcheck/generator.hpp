@@ -1,14 +1,31 @@
 #ifndef QCPPC_ARBITRARY_H_
 #define QCPPC_ARBITRARY_H_
 
+#include <iostream>
+#include <string>
 #include <vector>
+#include <array>
 #include <map>
+#include <memory>
+#include <optional>
 #include <random>
 #include <functional>
 #include <limits>
 #include <cassert>
 #include <type_traits>
 #include <typeinfo>
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <tuple>
+
+#include "utils.hpp"
+#include "alloc.hpp"
+#include "hash.hpp"
+#include "function.hpp"
+#include "reflect.hpp"
 
 namespace qcppc {
 
@@ -36,38 +53,485 @@ struct Arbitrary
 };
 
 // A wrapper for generators.
-// It can hold any function with type T().
+// It can hold any function with type T(), including ones that can't be
+// copied (see detail::Function). The values are only ever moved out of
+// it, so T may be a move-only type such as std::unique_ptr.
+//
+// If the function is a generator that knows its finite domain (see
+// utils::has_domain), the size of the domain and access to its values
+// are kept as well, so that small domains can be enumerated.
 template<typename T>
 struct Generator
 {
-    typedef std::function<T()> FunType;
+    typedef detail::Function<T()> FunType;
+    typedef detail::Function<T(size_t)> AtType;
 
     FunType fun;
 
-    Generator():fun(Arbitrary<T>()) {};
+    // The number of values the generator can produce, or 0 if it
+    // is unknown or too big to enumerate.
+    size_t domain_size;
 
-    Generator(const FunType & fun):fun(fun) {};
+    // The i-th value of the domain, for i < domain_size.
+    AtType at;
+
+    Generator():Generator(Arbitrary<T>()) {};
+
+    template<typename F, typename Enable = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, Generator<T>>::value>::type>
+    Generator(F && fun):domain_size(0), at(nullptr) {
+        set_domain(fun);
+        this->fun = FunType(std::forward<F>(fun));
+    }
 
     T operator()() {
         return fun();
     }
 
-    Generator<T> & operator=(const FunType & fun) {
-        this->fun = fun;
-        return *this;
+    template<typename F, typename Enable = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, Generator<T>>::value>::type>
+    Generator<T> & operator=(F && fun) {
+        return *this = Generator<T>(std::forward<F>(fun));
     }
+
+private:
+    // The domain is reached through a copy of the generator, so the
+    // generators that can't be copied are not enumerated.
+    template<typename F>
+    typename std::enable_if<utils::has_domain<F>::value &&
+        std::is_copy_constructible<F>::value>::type
+    set_domain(const F & f) {
+        domain_size = f.domain_size();
+        at = [f](size_t i) { return f.at(i); };
+    }
+
+    template<typename F>
+    typename std::enable_if<!utils::has_domain<F>::value ||
+        !std::is_copy_constructible<F>::value>::type
+    set_domain(const F &) {}
 };
 
-// Initialize and seed a random engine, ready to be used by
-// derived classes.
-struct ArbitraryBase
-{
-    std::mt19937 engine;
+namespace detail {
 
-    ArbitraryBase() {
+// The seed of the run. It is read from the environment variable QCPPC_SEED,
+// so that a run can be repeated, or else taken from std::random_device.
+inline uint64_t run_seed()
+{
+    static const uint64_t seed = []() -> uint64_t {
+        const char * env = std::getenv("QCPPC_SEED");
+        if (env && *env) {
+            return std::strtoull(env, nullptr, 10);
+        }
         std::random_device rd;
-        engine.seed(rd());
+        return (uint64_t(rd()) << 32) | rd();
+    }();
+    return seed;
+}
+
+// A different seed for every random engine, derived from the seed of
+// the run and the order in which the engines are created.
+inline uint64_t next_seed()
+{
+    static std::atomic<uint64_t> counter(0);
+    return mix64(run_seed() + counter++);
+}
+
+// The seed of the property with the given name, derived from the seed of
+// the run and the name only, so that the property draws the same inputs
+// in every run with the same seed, whichever properties were created or
+// ran before it. Runs that should draw other inputs pass an offset.
+inline uint64_t property_seed(const std::string & name, uint64_t offset = 0)
+{
+    return mix64(hash_combine(run_seed(), Hash<std::string>()(name)) + offset);
+}
+
+typedef std::mt19937 Engine;
+
+// A new engine, seeded with seed.
+inline Engine make_engine(uint64_t seed)
+{
+    return Engine(Engine::result_type(seed ^ (seed >> 32)));
+}
+
+// A new engine, seeded with the next seed.
+inline Engine make_engine()
+{
+    return make_engine(next_seed());
+}
+
+// The engine the generators on this thread draw from: the one of the
+// property running on it (see EngineScope), or else the thread's own.
+inline Engine *& current_engine()
+{
+    static thread_local Engine own = make_engine();
+    static thread_local Engine * current = &own;
+    return current;
+}
+
+// Makes engine the current one for its lifetime.
+struct EngineScope
+{
+    Engine * previous;
+
+    EngineScope(Engine * engine):previous(current_engine()) {
+        current_engine() = engine;
+    }
+
+    ~EngineScope() {
+        current_engine() = previous;
+    }
+};
+
+// A handle to the current engine, which can be passed to the random
+// number distributions as an engine. It holds no state, so that the
+// generators are cheap to construct and copy.
+struct EngineHandle
+{
+    typedef Engine::result_type result_type;
+
+    static constexpr result_type min() {
+        return Engine::min();
+    }
+
+    static constexpr result_type max() {
+        return Engine::max();
+    }
+
+    result_type operator()() {
+        return (*current_engine())();
+    }
+};
+
+// Fills the n bytes at p with random bytes from the current engine, four
+// at a time.
+inline void fill_random_bytes(void * p, size_t n)
+{
+    static_assert(Engine::min() == 0 && Engine::max() == 0xffffffffu,
+        "the engine should draw 32 random bits");
+    Engine & engine = *current_engine();
+    unsigned char * bytes = static_cast<unsigned char*>(p);
+    for (;n >= 4;bytes += 4, n -= 4) {
+        uint32_t r = uint32_t(engine());
+        std::memcpy(bytes, &r, 4);
+    }
+    if (n > 0) {
+        uint32_t r = uint32_t(engine());
+        std::memcpy(bytes, &r, n);
     }
+}
+
+// Whether any bit pattern is a valid value of T that its generator draws
+// as likely as any other, so that T can be filled with random bytes:
+// integral types other than bool, and arrays and aggregates of them.
+template<typename T, typename Enable = void>
+struct byte_fillable
+{
+    enum { value = std::is_integral<T>::value && !std::is_same<T, bool>::value };
+};
+
+template<typename T, size_t N>
+struct byte_fillable<T[N]> : byte_fillable<T> {};
+
+template<typename T, size_t N>
+struct byte_fillable<std::array<T, N>> : byte_fillable<T> {};
+
+template<typename T>
+struct byte_fillable<T, typename std::enable_if<is_reflectable<T>::value>::type>
+{
+    template<typename Fields>
+    struct All;
+
+    template<typename... Fields>
+    struct All<std::tuple<Fields...>>
+    {
+        enum { value = (... && byte_fillable<Fields>::value) };
+    };
+
+    enum { value = std::is_trivially_copyable<T>::value &&
+        All<typename fields_of<T>::type>::value };
+};
+
+// The type of the values generated for a field of type T: std::array for
+// the arrays, which can't be returned, and T itself otherwise.
+template<typename T>
+struct field_value
+{
+    typedef T type;
+};
+
+template<typename T, size_t N>
+struct field_value<T[N]>
+{
+    typedef std::array<typename field_value<T>::type, N> type;
+};
+
+template<typename T, typename V>
+void set_field(T & field, V && v)
+{
+    if constexpr (std::is_array<T>::value) {
+        static_assert(sizeof(T) == sizeof(V), "std::array should hold just the array");
+        std::memcpy(&field, &v, sizeof(T));
+    } else {
+        field = std::forward<V>(v);
+    }
+}
+
+// How many values the generators that mix in edge cases drew in the tests
+// of a property, and how many of them were edge cases of each kind.
+struct EdgeCounts
+{
+    size_t values;
+    std::map<std::string, size_t> edges;
+
+    EdgeCounts():values(0) {}
+};
+
+// The share of edge cases for the generators of the property running on
+// this thread that don't set their own (see Property::Edges), 0 outside
+// properties, and where they are counted.
+struct EdgeContext
+{
+    double rate;
+    EdgeCounts * counts;
+};
+
+// The share of edge cases of properties that don't set it (environment
+// variable QCPPC_EDGE_RATE), 0 by default.
+inline double default_edge_rate()
+{
+    static const double rate = []() {
+        const char * env = std::getenv("QCPPC_EDGE_RATE");
+        return env && *env ? std::atof(env) : 0.0;
+    }();
+    return rate;
+}
+
+inline EdgeContext & edge_context()
+{
+    static thread_local EdgeContext context = {0, nullptr};
+    return context;
+}
+
+// Installs an edge case context for its lifetime.
+struct EdgeScope
+{
+    EdgeContext previous;
+
+    EdgeScope(double rate, EdgeCounts * counts):previous(edge_context()) {
+        edge_context() = EdgeContext{rate, counts};
+    }
+
+    ~EdgeScope() {
+        edge_context() = previous;
+    }
+};
+
+// Stops counting allocations for its lifetime, for the bookkeeping of
+// generators, which is not the allocations of the generation.
+struct AllocOffScope
+{
+    AllocPhase phase;
+
+    AllocOffScope():phase(alloc_phase()) {
+        alloc_phase() = ALLOC_OFF;
+    }
+
+    ~AllocOffScope() {
+        alloc_phase() = phase;
+    }
+};
+
+inline void count_edge(EdgeCounts & counts, const char * kind)
+{
+    AllocOffScope off;
+    ++counts.edges[kind];
+}
+
+// The edge cases of a range: values of a few kinds, such as its bounds or
+// the powers of two.
+template<typename T>
+struct EdgeTable
+{
+    std::vector<const char*> kinds;
+    std::vector<std::vector<T>> values;
+
+    bool contains(const T & t) const {
+        for (auto &kind:values) {
+            for (auto &v:kind) {
+                if (std::memcmp(&v, &t, sizeof(T)) == 0) return true;
+            }
+        }
+        return false;
+    }
+
+    // Adds the value t of the given kind, unless it is already there.
+    void add(const char * kind, const T & t) {
+        if (contains(t)) {
+            return;
+        }
+        size_t k = std::find(kinds.begin(), kinds.end(), kind) - kinds.begin();
+        if (k == kinds.size()) {
+            kinds.push_back(kind);
+            values.emplace_back();
+        }
+        values[k].push_back(t);
+    }
+};
+
+// Edge cases mixed into the values of a generator at some rate. A kind is
+// chosen at random, then one of its values. The table of the values is
+// only listed (by make) when the first edge case is drawn, and is shared
+// by all the generators of the same range for the rest of the program, so
+// that generators stay small and cheap to construct.
+template<typename T>
+class EdgeCases
+{
+public:
+    typedef void (*MakeType)(EdgeTable<T> &, T low, T high);
+
+private:
+    MakeType make;
+    const EdgeTable<T> * table;
+
+    // The share of edge cases, negative for that of the property.
+    float rate;
+
+    // The table of make for the range from low to high, listed once.
+    static const EdgeTable<T> * table_of(MakeType make, T low, T high) {
+        typedef std::tuple<MakeType, T, T> Key;
+        struct Less {
+            bool operator()(const Key & a, const Key & b) const {
+                if (std::get<0>(a) != std::get<0>(b)) {
+                    return std::less<MakeType>()(std::get<0>(a), std::get<0>(b));
+                }
+                return std::make_pair(std::get<1>(a), std::get<2>(a)) <
+                    std::make_pair(std::get<1>(b), std::get<2>(b));
+            }
+        };
+        static std::mutex mutex;
+        static std::map<Key, std::unique_ptr<EdgeTable<T>>, Less> tables;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<EdgeTable<T>> & t = tables[Key(make, low, high)];
+        if (!t) {
+            t = std::make_unique<EdgeTable<T>>();
+            make(*t, low, high);
+        }
+        return t.get();
+    }
+
+public:
+    EdgeCases(MakeType make):make(make), table(nullptr), rate(-1) {}
+
+    // Lists the values with make from now on.
+    void set_make(MakeType m) {
+        make = m;
+        table = nullptr;
+    }
+
+    void set_rate(double r) {
+        rate = float(r);
+    }
+
+    // Sets t to an edge case of the range from low to high with the
+    // probability of the rate. Returns whether it did. Draws nothing from
+    // the engine if the rate is 0.
+    template<typename Engine>
+    bool draw(Engine & engine, T & t, T low, T high) {
+        const EdgeContext & context = edge_context();
+        double r = rate < 0 ? context.rate : rate;
+        if (context.counts) {
+            ++context.counts->values;
+        }
+        if (r <= 0 || std::uniform_real_distribution<double>(0, 1)(engine) >= r) {
+            return false;
+        }
+        if (!table) {
+            // The tables are kept for the next tests, they don't leak.
+            AllocOffScope off;
+            table = table_of(make, low, high);
+        }
+        const EdgeTable<T> & e = *table;
+        size_t k = std::uniform_int_distribution<size_t>(0, e.kinds.size() - 1)(engine);
+        t = e.values[k][std::uniform_int_distribution<size_t>(0, e.values[k].size() - 1)(engine)];
+        if (context.counts) {
+            count_edge(*context.counts, e.kinds[k]);
+        }
+        return true;
+    }
+};
+
+// The edge cases of the integers from low to high: the bounds, 0, 1, -1
+// and the powers of two, and the values next to them.
+template<typename IntType>
+void integer_edges(EdgeTable<IntType> & edges, IntType low, IntType high)
+{
+    auto add = [&edges, low, high](const char * kind, IntType v) {
+        if (low <= v && v <= high) edges.add(kind, v);
+    };
+    add("min", low);
+    add("max", high);
+    add("0", 0);
+    add("1", 1);
+    if (std::is_signed<IntType>::value) {
+        add("-1", IntType(-1));
+    }
+    for (int k = 1;k < std::numeric_limits<IntType>::digits;++k) {
+        IntType p = IntType(IntType(1) << k);
+        add("2^k", p);
+        add("2^k - 1", IntType(p - 1));
+        add("2^k + 1", IntType(p + 1));
+        if (std::is_signed<IntType>::value) {
+            add("-2^k", IntType(-p));
+            add("-2^k + 1", IntType(-p + 1));
+            add("-2^k - 1", IntType(-p - 1));
+        }
+    }
+}
+
+// The edge cases of the reals from low to high: the bounds, zeros, ones
+// and the extremes of the normal and denormal numbers.
+template<typename RealType>
+void real_edges(EdgeTable<RealType> & edges, RealType low, RealType high)
+{
+    typedef std::numeric_limits<RealType> limits;
+    auto add = [&edges, low, high](const char * kind, RealType v) {
+        if (low <= v && v <= high) edges.add(kind, v);
+    };
+    add("min", low);
+    add("max", high);
+    add("0", 0);
+    add("-0.0", -RealType(0));
+    add("1", 1);
+    add("-1", -1);
+    for (RealType sign:{RealType(1), RealType(-1)}) {
+        add("denormal", sign * limits::denorm_min());
+        add("denormal", sign * (limits::min() - limits::denorm_min()));
+        add("smallest normal", sign * limits::min());
+        add("epsilon", sign * limits::epsilon());
+        add("largest", sign * limits::max());
+    }
+}
+
+// Same as real_edges, and NaN and the infinities, which are out of any
+// range.
+template<typename RealType>
+void special_real_edges(EdgeTable<RealType> & edges, RealType low, RealType high)
+{
+    typedef std::numeric_limits<RealType> limits;
+    real_edges(edges, low, high);
+    edges.add("NaN", limits::quiet_NaN());
+    edges.add("inf", limits::infinity());
+    edges.add("-inf", -limits::infinity());
+}
+
+} // namespace detail
+
+// The random engine of derived classes: a handle to the engine of the
+// property being run (see detail::current_engine).
+struct ArbitraryBase
+{
+    // Static, as it holds no state, so that the base takes no room.
+    static inline detail::EngineHandle engine;
 };
 
 // Functor that returns always the same value.
@@ -81,6 +545,14 @@ struct Fixed
     T operator()() {
         return _val;
     }
+
+    size_t domain_size() const {
+        return 1;
+    }
+
+    T at(size_t) const {
+        return _val;
+    }
 };
 
 // Functor that returns randomly and with equal probability
@@ -98,6 +570,14 @@ struct OneOf : ArbitraryBase
     T operator()() {
         return _vals[dist(engine)];
     }
+
+    size_t domain_size() const {
+        return _vals.size();
+    }
+
+    T at(size_t i) const {
+        return _vals[i];
+    }
 };
 
 // Weighted version of OneOf functor.
@@ -124,6 +604,15 @@ struct Freq : ArbitraryBase
     T operator()() {
         return _vals[dist(engine)];
     }
+
+    // When enumerated, every value is used once regardless of its weight.
+    size_t domain_size() const {
+        return _vals.size();
+    }
+
+    T at(size_t i) const {
+        return _vals[i];
+    }
 };
 
 // Arbitrary specialization for bool.
@@ -137,41 +626,88 @@ struct Arbitrary<bool> : ArbitraryBase
     bool operator()() {
         return static_cast<bool>(dist(engine));
     }
+
+    size_t domain_size() const {
+        return 2;
+    }
+
+    bool at(size_t i) const {
+        return i != 0;
+    }
 };
 
 // Arbitrary specialization for all integral types (signed and unsigned).
+//
+// Edge cases (see detail::integer_edges) are mixed in at the rate of the
+// property (see Property::Edges), or the one set with Edges.
 template<typename IntType>
 struct Arbitrary<IntType, typename std::enable_if<
                     std::is_integral<IntType>::value>::type>
     : ArbitraryBase
 {
     std::uniform_int_distribution<IntType> dist;
+    detail::EdgeCases<IntType> edges;
 
     Arbitrary(IntType low = std::numeric_limits<IntType>::min(),
               IntType high = std::numeric_limits<IntType>::max()):
-            dist(low, high) {
+            dist(low, high), edges(detail::integer_edges<IntType>) {
         assert(low <= high);
     }
 
+    // Mixes in edge cases at the given rate, from 0 (none) to 1.
+    Arbitrary & Edges(double rate) {
+        edges.set_rate(rate);
+        return *this;
+    }
+
     IntType operator()() {
-        return dist(engine);
+        IntType t;
+        return edges.draw(engine, t, dist.a(), dist.b()) ? t : dist(engine);
+    }
+
+    // Wraps around to 0, i.e. unknown, for the full range of the widest types.
+    size_t domain_size() const {
+        typedef typename std::make_unsigned<IntType>::type UType;
+        return size_t(UType(dist.b()) - UType(dist.a())) + 1;
+    }
+
+    IntType at(size_t i) const {
+        typedef typename std::make_unsigned<IntType>::type UType;
+        return IntType(UType(dist.a()) + UType(i));
     }
 };
 
 // Arbitrary specialization for floating point types.
+//
+// Edge cases (see detail::real_edges) are mixed in as for integral types.
 template<typename RealType>
 struct Arbitrary<RealType, typename std::enable_if<
                 std::is_floating_point<RealType>::value>::type>
     : ArbitraryBase
 {
     std::uniform_real_distribution<RealType> dist;
+    detail::EdgeCases<RealType> edges;
 
-    Arbitrary(RealType low = -1.0, RealType high = 1.0):dist(low, high) {
+    Arbitrary(RealType low = -1.0, RealType high = 1.0):dist(low, high),
+        edges(detail::real_edges<RealType>) {
        assert(low <= high);
     }
 
+    // Mixes in edge cases at the given rate, from 0 (none) to 1.
+    Arbitrary & Edges(double rate) {
+        edges.set_rate(rate);
+        return *this;
+    }
+
+    // Mixes NaN, inf and -inf in with the edge cases too.
+    Arbitrary & Specials() {
+        edges.set_make(detail::special_real_edges<RealType>);
+        return *this;
+    }
+
     RealType operator()() {
-        return dist(engine);
+        RealType t;
+        return edges.draw(engine, t, dist.a(), dist.b()) ? t : dist(engine);
     }
 };
 
@@ -233,6 +769,168 @@ struct Arbitrary<std::vector<T>> : ArbitraryBase
     }
 };
 
+// Arbitrary specialization for std::unique_ptr, which owns an arbitrary T.
+template<typename T>
+struct Arbitrary<std::unique_ptr<T>>
+{
+    std::function<T()> gen;
+
+    Arbitrary():Arbitrary<std::unique_ptr<T>>(Arbitrary<T>()) {}
+
+    // Uses gen as the generator for the pointed-to value.
+    Arbitrary(const std::function<T()> & gen):gen(gen) {}
+
+    std::unique_ptr<T> operator()() {
+        return std::unique_ptr<T>(new T(gen()));
+    }
+};
+
+// Arbitrary specialization for std::array. Arrays of integral types are
+// filled with random bytes at once (see detail::byte_fillable), unless
+// a generator for the elements is given.
+template<typename T, size_t N>
+struct Arbitrary<std::array<T, N>> : ArbitraryBase
+{
+    std::function<T()> gen;
+
+    Arbitrary() {
+        if (!detail::byte_fillable<T>::value) {
+            gen = Arbitrary<T>();
+        }
+    }
+
+    // Uses gen as the generator for the elements.
+    Arbitrary(const std::function<T()> & gen):gen(gen) {}
+
+    std::array<T, N> operator()() {
+        std::array<T, N> a;
+        if (!gen) {
+            detail::fill_random_bytes(a.data(), sizeof(a));
+            return a;
+        }
+        for (auto &t:a) {
+            t = gen();
+        }
+        return a;
+    }
+};
+
+// Arbitrary specialization for trivially copyable aggregates, such as
+// plain structs of numbers, whose fields are found by reflection (see
+// reflect.hpp). Each field is drawn by its own generator, Arbitrary<F>
+// unless set with Rnd, Fix, One or Frq, with the index of the field as
+// for the arguments of a property, e.g.
+//
+//      Arbitrary<Header>().Fix<0>(80).Rnd<2>(0, 9)
+//
+// When every field is integral, or an array or aggregate of such (see
+// detail::byte_fillable), the object is filled with random bytes at once
+// instead, and only the fields that are set are drawn on top: such fields
+// take any value equally likely, without edge cases.
+template<typename T>
+struct Arbitrary<T, typename std::enable_if<detail::is_reflectable<T>::value &&
+        std::is_trivially_copyable<T>::value>::type> : ArbitraryBase
+{
+    typedef typename detail::fields_of<T>::type FieldsType;
+
+    template<size_t I>
+    using FieldType = typename detail::field_value<
+        typename std::tuple_element<I, FieldsType>::type>::type;
+
+    template<typename Indices>
+    struct FieldGenerators;
+
+    template<size_t... I>
+    struct FieldGenerators<std::index_sequence<I...>>
+    {
+        typedef std::tuple<std::optional<Generator<FieldType<I>>>...> type;
+    };
+
+    typedef std::make_index_sequence<detail::fields_of<T>::size> Indices;
+
+    // The generators of the fields, empty until set or first needed.
+    typename FieldGenerators<Indices>::type fields;
+
+    // Sets fun as the generator of field I.
+    template<size_t I, typename F = std::function<FieldType<I>()>>
+    Arbitrary & Rnd(F && fun) {
+        std::get<I>(fields).emplace(std::forward<F>(fun));
+        return *this;
+    }
+
+    // Sets Arbitrary<F>(params...) as the generator of field I.
+    template<size_t I, typename... Params, typename Enable =
+            typename std::enable_if<(sizeof...(Params) > 1)>::type>
+    Arbitrary & Rnd(Params... params) {
+        std::get<I>(fields).emplace(Arbitrary<FieldType<I>>(params...));
+        return *this;
+    }
+
+    template<size_t I>
+    Arbitrary & Fix(const FieldType<I> & v) {
+        std::get<I>(fields).emplace(Fixed<FieldType<I>>(v));
+        return *this;
+    }
+
+    template<size_t I>
+    Arbitrary & One(const std::vector<FieldType<I>> & v) {
+        std::get<I>(fields).emplace(OneOf<FieldType<I>>(v));
+        return *this;
+    }
+
+    template<size_t I>
+    Arbitrary & Frq(const std::map<FieldType<I>, double> & m) {
+        std::get<I>(fields).emplace(Freq<FieldType<I>>(m));
+        return *this;
+    }
+
+    T operator()() {
+        T t{};
+        if (detail::byte_fillable<T>::value) {
+            detail::fill_random_bytes(&t, sizeof(T));
+        }
+        draw_fields(detail::tie_fields<detail::fields_of<T>::size>(t), Indices());
+        return t;
+    }
+
+private:
+    template<typename Refs, size_t... I>
+    void draw_fields(Refs refs, std::index_sequence<I...>) {
+        (draw_field<I>(std::get<I>(refs)), ...);
+    }
+
+    template<size_t I, typename F>
+    void draw_field(F & field) {
+        auto &gen = std::get<I>(fields);
+        if (!gen) {
+            if (detail::byte_fillable<T>::value) {
+                return;
+            }
+            // Kept for the next values, so not an allocation of this one.
+            detail::AllocOffScope off;
+            gen.emplace(Arbitrary<FieldType<I>>());
+        }
+        detail::set_field(field, (*gen)());
+    }
+};
+
+// The generators of the most common types. With QCPPC_USE_LIBRARY defined,
+// they are not instantiated in every translation unit that uses them but
+// once, in libqcppc (see quickcppcheck/Makefile), which is linked instead.
+#define QCPPC_COMMON_TYPES(X) \
+    X(char) X(int) X(unsigned int) X(long) X(unsigned long) \
+    X(long long) X(unsigned long long) X(float) X(double) \
+    X(std::string) X(std::vector<int>)
+
+#ifdef QCPPC_USE_LIBRARY
+#define QCPPC_EXTERN_GENERATOR(T) \
+    extern template struct Arbitrary<T>; \
+    extern template struct Generator<T>;
+QCPPC_COMMON_TYPES(QCPPC_EXTERN_GENERATOR)
+extern template struct Generator<bool>;
+#undef QCPPC_EXTERN_GENERATOR
+#endif
+
 } // namespace qcppc
 
 
@@ -0,0 +1,174 @@
+// Hashing of generated values for qcppc.
+
+#ifndef QCPPC_HASH_H_
+#define QCPPC_HASH_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+namespace qcppc {
+
+namespace detail {
+
+// Mixes the bits of x thoroughly (the finalizer of splitmix64).
+inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+inline uint64_t hash_combine(uint64_t seed, uint64_t h)
+{
+    return mix64(seed ^ (h + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+}
+
+} // namespace detail
+
+// Class template Hash<T> may be specialized for user defined types,
+// so that values of that type can be recognized when generated again
+// (see Property::Dedup). The specialization should provide a call
+// operator with type uint64_t operator()(const T&) const.
+//
+// The primary template marks types that can't be hashed.
+template<typename T, typename Enable = void>
+struct Hash
+{
+    static const bool enabled = false;
+
+    uint64_t operator()(const T &) const {
+        return 0;
+    }
+};
+
+// Hash specialization for arithmetic types: their bit pattern.
+template<typename T>
+struct Hash<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+{
+    static const bool enabled = true;
+
+    uint64_t operator()(const T & t) const {
+        uint64_t bits = 0;
+        std::memcpy(&bits, &t, sizeof(T) < sizeof(bits) ? sizeof(T) : sizeof(bits));
+        return detail::mix64(bits);
+    }
+};
+
+template<typename charT>
+struct Hash<std::basic_string<charT>>
+{
+    static const bool enabled = Hash<charT>::enabled;
+
+    uint64_t operator()(const std::basic_string<charT> & s) const {
+        uint64_t h = s.size();
+        for (auto &c:s) h = detail::hash_combine(h, Hash<charT>()(c));
+        return h;
+    }
+};
+
+template<typename T>
+struct Hash<std::vector<T>>
+{
+    static const bool enabled = Hash<T>::enabled;
+
+    uint64_t operator()(const std::vector<T> & v) const {
+        uint64_t h = v.size();
+        for (auto &t:v) h = detail::hash_combine(h, Hash<T>()(t));
+        return h;
+    }
+};
+
+template<typename T, typename U>
+struct Hash<std::pair<T, U>>
+{
+    static const bool enabled = Hash<T>::enabled && Hash<U>::enabled;
+
+    uint64_t operator()(const std::pair<T, U> & p) const {
+        return detail::hash_combine(Hash<T>()(p.first), Hash<U>()(p.second));
+    }
+};
+
+template<typename K, typename V>
+struct Hash<std::map<K, V>>
+{
+    static const bool enabled = Hash<std::pair<K, V>>::enabled;
+
+    uint64_t operator()(const std::map<K, V> & m) const {
+        uint64_t h = m.size();
+        for (auto &kv:m) {
+            h = detail::hash_combine(h, Hash<std::pair<K, V>>()(
+                        std::pair<K, V>(kv.first, kv.second)));
+        }
+        return h;
+    }
+};
+
+namespace detail {
+
+// Hashes all the elements of a tuple.
+template<typename... Types>
+uint64_t tuple_hash(const std::tuple<Types...> & tup)
+{
+    return std::apply([](const Types &... t) {
+                uint64_t h = 0;
+                ((h = hash_combine(h, Hash<Types>()(t))), ...);
+                return h;
+            }, tup);
+}
+
+template<typename... Types>
+struct all_hashable {
+    static const bool value = (Hash<Types>::enabled && ... && true);
+};
+
+// A blocked Bloom filter of fixed size. Every value sets K bits within
+// a single 512 bit block, so that a lookup touches one cache line.
+// The K bit positions take 9 bits each from one 64 bit hash.
+// It may report a value it has never seen as seen (rarely, as long as
+// it is not overfilled), never the other way around.
+class BloomFilter
+{
+private:
+    static const size_t BLOCK_WORDS = 8;
+    static const size_t K = 7;
+
+    std::vector<uint64_t> words;
+    size_t nblocks;
+
+public:
+    // Creates a filter that uses (about) the given number of bytes.
+    BloomFilter(size_t bytes = 0):
+        words(std::max<size_t>(1, bytes / (8 * BLOCK_WORDS)) * BLOCK_WORDS, 0),
+        nblocks(words.size() / BLOCK_WORDS)
+    {}
+
+    // Adds the value with hash h. Returns false if it was (probably)
+    // added before.
+    bool insert(uint64_t h)
+    {
+        uint64_t * block = &words[(h >> 32) % nblocks * BLOCK_WORDS];
+        uint64_t bits = mix64(h);
+        bool added = false;
+        for (size_t k = 0;k < K;++k, bits >>= 9) {
+            size_t bit = bits & 511;
+            uint64_t mask = uint64_t(1) << (bit & 63);
+            added = added || !(block[bit >> 6] & mask);
+            block[bit >> 6] |= mask;
+        }
+        return added;
+    }
+};
+
+} // namespace detail
+} // namespace qcppc
+
+#endif // QCPPC_HASH_H_
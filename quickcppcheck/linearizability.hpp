@@ -0,0 +1,191 @@
+// Linearizability checking for qcppc.
+//
+// A concurrent history is a set of operations, each with the time it was
+// called and the time it returned. It is linearizable if the operations
+// can be put in a sequential order that respects real time (an operation
+// that returned before another was called comes first) and under which
+// a sequential model produces the recorded results.
+
+#ifndef QCPPC_LINEARIZABILITY_H_
+#define QCPPC_LINEARIZABILITY_H_
+
+#include <vector>
+#include <set>
+#include <chrono>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(QCPPC_NO_RDTSC)
+#include <x86intrin.h>
+#endif
+
+namespace qcppc {
+namespace detail {
+
+// A cheap timestamp for call and return events. On x86 it reads the time
+// stamp counter, which is synchronized across cores on current hardware;
+// define QCPPC_NO_RDTSC to use std::chrono::steady_clock instead.
+// rdtscp waits for the preceding instructions to complete and the fence
+// keeps the following ones from starting before the read.
+inline uint64_t timestamp()
+{
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(QCPPC_NO_RDTSC)
+    unsigned int aux;
+    uint64_t t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// An operation of a concurrent history. cmd and slot identify what
+// was called, the checker does not interpret them.
+struct Operation
+{
+    size_t thread;
+    size_t cmd;
+    size_t slot;
+    uint64_t call;
+    uint64_t ret;
+};
+
+template<typename T>
+struct is_less_comparable
+{
+    template<typename U> static char test(decltype(std::declval<const U&>() <
+                std::declval<const U&>()) *);
+    template<typename U> static int test(...);
+
+    enum { value = sizeof(test<T>(0)) == 1 };
+};
+
+// The set of (linearized operations, model state) pairs that have already
+// been explored. A configuration reached a second time, by linearizing the
+// same operations in a different order, can't lead anywhere new.
+template<typename Model, bool = is_less_comparable<Model>::value>
+struct ExploredCache
+{
+    std::set<std::pair<std::vector<bool>, Model>> seen;
+
+    bool insert(const std::vector<bool> & linearized, const Model & model) {
+        return seen.insert(std::make_pair(linearized, model)).second;
+    }
+};
+
+// Without an ordering on the model there is no memoization, only the
+// plain search.
+template<typename Model>
+struct ExploredCache<Model, false>
+{
+    bool insert(const std::vector<bool> &, const Model &) {
+        return true;
+    }
+};
+
+// Checks whether history is linearizable with the Wing-Gong search,
+// with the memoization of explored configurations proposed by Lowe.
+//
+// apply(Model&, const Operation&) applies an operation to the model and
+// returns whether the result matches the recorded one.
+//
+// On success model is left in the state after the found linearization.
+template<typename Model, typename Apply>
+bool check_linearizable(const std::vector<Operation> & history,
+        Model & model, Apply apply)
+{
+    // The history as a doubly linked list of call and return events in
+    // time order. Entry 0 is the head sentinel; calls go before returns
+    // on equal timestamps, so that ties are taken as overlapping.
+    struct Entry {
+        size_t op;
+        bool call;
+        size_t match;
+        size_t prev, next;
+    };
+    typedef std::pair<std::pair<uint64_t, bool>, size_t> Event;
+
+    const size_t n = history.size();
+    std::vector<Event> events;
+    for (size_t i = 0;i < n;++i) {
+        events.push_back(Event(std::make_pair(history[i].call, false), i));
+        events.push_back(Event(std::make_pair(history[i].ret, true), i));
+    }
+    std::sort(events.begin(), events.end());
+
+    const size_t END = events.size() + 1;
+    std::vector<Entry> list(events.size() + 1);
+    std::vector<size_t> call_of(n);
+    list[0] = Entry{0, false, 0, END, 1};
+    for (size_t e = 1;e <= events.size();++e) {
+        size_t op = events[e - 1].second;
+        bool call = !events[e - 1].first.second;
+        list[e] = Entry{op, call, 0, e - 1, e == events.size() ? END : e + 1};
+        if (call) {
+            call_of[op] = e;
+        } else {
+            list[e].match = call_of[op];
+            list[call_of[op]].match = e;
+        }
+    }
+
+    // Removes an operation (its call and return entries) from the list.
+    auto lift = [&list, END](size_t e) {
+        size_t m = list[e].match;
+        list[list[e].prev].next = list[e].next;
+        if (list[e].next != END) list[list[e].next].prev = list[e].prev;
+        list[list[m].prev].next = list[m].next;
+        if (list[m].next != END) list[list[m].next].prev = list[m].prev;
+    };
+    // Puts back an operation removed by lift.
+    auto unlift = [&list, END](size_t e) {
+        size_t m = list[e].match;
+        list[list[m].prev].next = m;
+        if (list[m].next != END) list[list[m].next].prev = m;
+        list[list[e].prev].next = e;
+        if (list[e].next != END) list[list[e].next].prev = e;
+    };
+
+    ExploredCache<Model> cache;
+    std::vector<bool> linearized(n, false);
+    std::vector<std::pair<size_t, Model>> stack;
+
+    size_t e = list[0].next;
+    while (list[0].next != END) {
+        if (list[e].call) {
+            Model next = model;
+            size_t op = list[e].op;
+            if (apply(next, history[op])) {
+                linearized[op] = true;
+                if (cache.insert(linearized, next)) {
+                    stack.push_back(std::make_pair(e, model));
+                    model = next;
+                    lift(e);
+                    e = list[0].next;
+                    continue;
+                }
+                linearized[op] = false;
+            }
+            e = list[e].next;
+        } else {
+            // An operation returned before any of the pending ones could
+            // be linearized: undo the last choice and try the next one.
+            if (stack.empty()) {
+                return false;
+            }
+            e = stack.back().first;
+            model = stack.back().second;
+            stack.pop_back();
+            linearized[list[e].op] = false;
+            unlift(e);
+            e = list[e].next;
+        }
+    }
+    return true;
+}
+
+} // namespace detail
+} // namespace qcppc
+
+#endif // QCPPC_LINEARIZABILITY_H_
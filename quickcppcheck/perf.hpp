@@ -0,0 +1,267 @@
+// Hardware performance counters for qcppc.
+//
+// With Property::Perf, the calls of the property function are measured
+// with the performance counters of the CPU (Linux perf_event_open):
+// cycles, instructions, cache misses and branch misses, per property and
+// per class (see Property::Classify). Counters that can't be opened, e.g.
+// in most VMs or with a restrictive kernel.perf_event_paranoid, are left
+// out; the time per call is always measured.
+
+#ifndef QCPPC_PERF_H_
+#define QCPPC_PERF_H_
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <map>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "extension.hpp"
+
+namespace qcppc {
+namespace detail {
+
+enum PerfEvent { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, NUM_PERF_EVENTS };
+
+inline const char * perf_event_name(int e)
+{
+    static const char * names[] = {"cycles", "instructions", "cache misses", "branch misses"};
+    return names[e];
+}
+
+// Sums of the measurements of a number of calls.
+struct PerfTotals
+{
+    uint64_t calls;
+    double seconds;
+    double counts[NUM_PERF_EVENTS];
+
+    PerfTotals():calls(0), seconds(0) {
+        for (auto &c:counts) c = 0;
+    }
+};
+
+// A group of counters of the calling thread, enabled around every call
+// that is measured.
+class PerfCounters
+{
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // The file descriptors of the counters, -1 for those not available.
+    int fds[NUM_PERF_EVENTS];
+
+    // The group leader, the first counter that could be opened.
+    int leader;
+
+    // Why no counter could be opened, if so.
+    std::string error;
+
+    Clock::time_point start_time;
+
+public:
+    PerfCounters():leader(-1) {
+        for (auto &fd:fds) fd = -1;
+#if defined(__linux__)
+        static const uint64_t configs[] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+        for (int e = 0;e < NUM_PERF_EVENTS;++e) {
+            struct perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[e];
+            attr.disabled = leader == -1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP |
+                PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[e] = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fds[e] == -1) {
+                if (error.empty()) error = std::strerror(errno);
+            } else if (leader == -1) {
+                leader = fds[e];
+            }
+        }
+#else
+        error = "not supported on this platform";
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters & operator=(const PerfCounters &) = delete;
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (auto fd:fds) if (fd != -1) close(fd);
+#endif
+    }
+
+    bool available(int e) const {
+        return fds[e] != -1;
+    }
+
+    bool any_available() const {
+        return leader != -1;
+    }
+
+    const std::string & why_unavailable() const {
+        return error;
+    }
+
+    void start() {
+#if defined(__linux__)
+        if (leader != -1) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+        start_time = Clock::now();
+    }
+
+    // Adds the counts since start to totals.
+    void stop(PerfTotals & totals) {
+        auto end_time = Clock::now();
+#if defined(__linux__)
+        if (leader != -1) {
+            ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            uint64_t buf[3 + NUM_PERF_EVENTS];
+            if (read(leader, buf, sizeof(buf)) > 0) {
+                // The counts are scaled up if the counters had to share
+                // the hardware with others (multiplexing).
+                double scale = buf[2] ? double(buf[1]) / buf[2] : 1;
+                uint64_t k = 0;
+                for (int e = 0;e < NUM_PERF_EVENTS && k < buf[0];++e) {
+                    if (fds[e] != -1) {
+                        totals.counts[e] += buf[3 + k++] * scale;
+                    }
+                }
+            }
+        }
+#endif
+        totals.seconds += std::chrono::duration<double>(end_time - start_time).count();
+        ++totals.calls;
+    }
+};
+
+// The measurements of a property, in total and per class.
+struct PerfCollector
+{
+    PerfCounters counters;
+    PerfTotals total;
+    std::map<std::string, PerfTotals> classes;
+
+    void start() {
+        counters.start();
+    }
+
+    void stop(const std::string & label) {
+        PerfTotals call;
+        counters.stop(call);
+        add(total, call);
+        if (!label.empty()) {
+            add(classes[label], call);
+        }
+    }
+
+    static void add(PerfTotals & to, const PerfTotals & from) {
+        to.calls += from.calls;
+        to.seconds += from.seconds;
+        for (int e = 0;e < NUM_PERF_EVENTS;++e) to.counts[e] += from.counts[e];
+    }
+
+    // Prints the averages per call.
+    void print_line(std::ostream & out, const PerfTotals & t) const {
+        std::ios::fmtflags flags = out.flags();
+        std::streamsize precision = out.precision();
+        out<<t.calls<<" calls, per call: "<<std::fixed<<std::setprecision(1)
+            <<t.seconds / t.calls * 1e9<<" ns";
+        for (int e = 0;e < NUM_PERF_EVENTS;++e) {
+            if (counters.available(e)) {
+                out<<", "<<t.counts[e] / t.calls<<" "<<perf_event_name(e);
+            }
+        }
+        if (counters.available(CYCLES) && counters.available(INSTRUCTIONS) &&
+                t.counts[CYCLES] > 0) {
+            out<<" ("<<std::setprecision(2)<<t.counts[INSTRUCTIONS] / t.counts[CYCLES]<<" IPC)";
+        }
+        out<<std::endl;
+        out.flags(flags);
+        out.precision(precision);
+    }
+
+    void print_results(std::ostream & out) const {
+        if (total.calls == 0) {
+            return;
+        }
+        out<<"  perf: ";
+        print_line(out, total);
+        if (!counters.any_available()) {
+            out<<"  perf: hardware counters unavailable ("
+                <<counters.why_unavailable()<<"), only time is measured."<<std::endl;
+        }
+        for (auto &it:classes) {
+            out<<"    "<<it.first<<": ";
+            print_line(out, it.second);
+        }
+    }
+};
+
+// Measures the calls of the property function, see Property::Perf. The
+// counters count the thread that opens them, so they are opened on every
+// run, and the measurements of workers are not merged, so they are not
+// taken when sharded.
+struct PerfExtension : Extension
+{
+    std::shared_ptr<PerfCollector> perf;
+
+    std::unique_ptr<Extension> clone() const override {
+        return std::make_unique<PerfExtension>(*this);
+    }
+
+    bool prefers_one_process() const override {
+        return true;
+    }
+
+    void begin_run(const std::string &, bool async, bool sharded, bool) override {
+        perf.reset();
+        if (!async && !sharded) {
+            perf = std::make_shared<PerfCollector>();
+        }
+    }
+
+    void begin_call() override {
+        if (perf) {
+            perf->start();
+        }
+    }
+
+    void end_call(const std::string & label) override {
+        if (perf) {
+            perf->stop(label);
+        }
+    }
+
+    void print_results(std::ostream & out) const override {
+        if (perf) {
+            perf->print_results(out);
+        }
+    }
+};
+
+} // namespace detail
+} // namespace qcppc
+
+#endif // QCPPC_PERF_H_
@@ -0,0 +1,92 @@
+// A pool of memory blocks for qcppc, used for coroutine frames.
+//
+// A Property makes a pool when a coroutine generator (see coroutine.hpp)
+// is set for one of its arguments, and installs it as the current one of
+// its thread while its tests run. Coroutine generators started meanwhile
+// take their frames from it, and return them to it when they finish, so
+// that restarting a coroutine doesn't hit the allocator.
+
+#ifndef QCPPC_POOL_H_
+#define QCPPC_POOL_H_
+
+#include <new>
+#include <map>
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+
+namespace qcppc {
+namespace detail {
+
+class FramePool
+{
+private:
+    static const size_t GRANULE = 64;
+
+    // Free blocks by (rounded up) size.
+    std::map<size_t, std::vector<void*>> free;
+
+    static size_t round(size_t n) {
+        return (n + GRANULE - 1) / GRANULE * GRANULE;
+    }
+
+public:
+    FramePool() {}
+
+    FramePool(const FramePool &) = delete;
+    FramePool & operator=(const FramePool &) = delete;
+
+    ~FramePool() {
+        for (auto &it:free) {
+            for (auto p:it.second) ::operator delete(p);
+        }
+    }
+
+    void * allocate(size_t n) {
+        std::vector<void*> & blocks = free[round(n)];
+        if (blocks.empty()) {
+            return ::operator new(round(n));
+        }
+        void * p = blocks.back();
+        blocks.pop_back();
+        return p;
+    }
+
+    void deallocate(void * p, size_t n) {
+        free[round(n)].push_back(p);
+    }
+};
+
+// Whether the generator G takes frames from the current pool, which it
+// declares with a uses_frame_pool member type.
+template<typename G, typename Enable = void>
+struct uses_frame_pool : std::false_type {};
+
+template<typename G>
+struct uses_frame_pool<G, std::void_t<typename G::uses_frame_pool>> : std::true_type {};
+
+// The pool of the property running on this thread, if any.
+inline FramePool *& current_frame_pool()
+{
+    static thread_local FramePool * pool = nullptr;
+    return pool;
+}
+
+// Installs a pool as the current one for its lifetime.
+struct FramePoolScope
+{
+    FramePool * previous;
+
+    FramePoolScope(FramePool * pool):previous(current_frame_pool()) {
+        current_frame_pool() = pool;
+    }
+
+    ~FramePoolScope() {
+        current_frame_pool() = previous;
+    }
+};
+
+} // namespace detail
+} // namespace qcppc
+
+#endif // QCPPC_POOL_H_
@@ -2,22 +2,117 @@
 #define QCPPC_PRINTER_H_
 
 #include <tuple>
+#include <utility>
+#include <string>
 #include <sstream>
+#include <vector>
+#include <streambuf>
+#include <algorithm>
+#include <cstdlib>
 
 namespace qcppc {
 namespace detail {
 
-template<typename T>
-std::ostream& operator<<(std::ostream& out, const std::vector<T> & v)
+// How much of a value is printed: at most elements elements of a vector,
+// vectors nested at most depth deep and at most chars characters of every
+// argument, 0 for no limit. See qcppc::limit_printing.
+struct PrintLimits
 {
-    out<<"V<";
-    for (size_t i = 0;i < v.size();++i) {
-        out<<v[i]<<", ";
-    }
-    out<<">";
-    return out;
+    size_t elements;
+    size_t depth;
+    size_t chars;
+};
+
+inline PrintLimits & print_limits()
+{
+    static PrintLimits limits = {100, 4, 4096};
+    return limits;
 }
 
+// Whether this thread prints values in full, whatever the limits.
+inline bool & print_unlimited()
+{
+    static thread_local bool unlimited = false;
+    return unlimited;
+}
+
+// How deep in nested vectors this thread is printing.
+inline size_t & print_depth()
+{
+    static thread_local size_t depth = 0;
+    return depth;
+}
+
+// Where failing inputs are saved in full, empty if they aren't (see
+// qcppc::save_full_inputs), by default the environment variable
+// QCPPC_FULL_INPUTS.
+inline std::string & full_inputs_path()
+{
+    static std::string path = []() {
+        const char * env = std::getenv("QCPPC_FULL_INPUTS");
+        return std::string(env ? env : "");
+    }();
+    return path;
+}
+
+// Prints in full on this thread for its lifetime.
+struct UnlimitedPrinting
+{
+    bool previous;
+
+    UnlimitedPrinting():previous(print_unlimited()) {
+        print_unlimited() = true;
+    }
+
+    ~UnlimitedPrinting() {
+        print_unlimited() = previous;
+    }
+};
+
+// Passes at most limit characters on to target, and fails after that, so
+// that the stream stops formatting the rest of the value.
+class BoundedBuffer : public std::streambuf
+{
+private:
+    std::streambuf * target;
+    size_t left;
+    bool truncated;
+
+protected:
+    int_type overflow(int_type c) {
+        if (traits_type::eq_int_type(c, traits_type::eof())) {
+            return traits_type::not_eof(c);
+        }
+        if (left == 0) {
+            truncated = true;
+            return traits_type::eof();
+        }
+        --left;
+        return target->sputc(traits_type::to_char_type(c));
+    }
+
+    std::streamsize xsputn(const char * s, std::streamsize n) {
+        std::streamsize put = target->sputn(s, std::min<std::streamsize>(n, left));
+        left -= put;
+        if (put < n) {
+            truncated = true;
+        }
+        return put;
+    }
+
+public:
+    BoundedBuffer(std::streambuf * target, size_t limit):
+        target(target), left(limit), truncated(false)
+    {}
+
+    bool was_truncated() const {
+        return truncated;
+    }
+};
+
+template<typename T>
+std::ostream& print_helper(std::ostream &out, const std::vector<T> & v);
+
 template<typename T>
 typename std::enable_if<
         utils::is_printable<T>::value,
@@ -38,31 +133,65 @@ print_helper(std::ostream &out, const T& t)
     return out<<"???";
 }
 
-template<size_t N>
-struct tuple_printer_impl {
-    template<typename Fun, typename... Types>
-    void operator()(const Fun & fun, const std::tuple<Types...> & tup) {
-        tuple_printer_impl<N-1>()(fun, tup);
-        fun(std::get<N - 1>(tup), sizeof...(Types) - N);
+// Past the limits, only the number of elements is printed.
+template<typename T>
+std::ostream& print_helper(std::ostream &out, const std::vector<T> & v)
+{
+    const PrintLimits & limits = print_limits();
+    bool unlimited = print_unlimited();
+    size_t & depth = print_depth();
+    if (!unlimited && limits.depth && depth >= limits.depth) {
+        return out<<"V<"<<v.size()<<" elements>";
     }
-};
-
-template<>
-struct tuple_printer_impl<0> {
-    template<typename Fun, typename... Types>
-    void operator()(const Fun & fun, const std::tuple<Types...> & tup) {
+    size_t n = v.size();
+    if (!unlimited && limits.elements) {
+        n = std::min(n, limits.elements);
     }
-};
+    ++depth;
+    out<<"V<";
+    for (size_t i = 0;i < n;++i) {
+        print_helper(out, v[i])<<", ";
+    }
+    if (n < v.size()) {
+        out<<"... "<<v.size() - n<<" more, "<<v.size()<<" in all";
+    }
+    out<<">";
+    --depth;
+    return out;
+}
 
-struct tuple_printer {
-    std::ostream & out;
-    std::string delimiter;
-    tuple_printer(std::ostream &out, std::string delimiter):out(out),delimiter(delimiter){}
-    template<typename T>
-    void operator()(const T & t, size_t n) const {
-        print_helper(out,t); if (n) out<<delimiter;
+template<typename T>
+std::ostream& operator<<(std::ostream& out, const std::vector<T> & v)
+{
+    return print_helper(out, v);
+}
+
+// Prints an argument of an input. Arguments longer than the limit are
+// cut, and marked with "...".
+template<typename T>
+std::ostream& print_bounded(std::ostream &out, const T& t)
+{
+    size_t chars = print_limits().chars;
+    if (print_unlimited() || chars == 0) {
+        return print_helper(out, t);
     }
-};
+    BoundedBuffer buffer(out.rdbuf(), chars);
+    std::ostream bounded(&buffer);
+    bounded.copyfmt(out);
+    print_helper(bounded, t);
+    if (buffer.was_truncated()) {
+        out<<"...";
+    }
+    return out;
+}
+
+template<typename... Types, size_t... I>
+void print_elements(std::ostream & out, const std::string & delimiter,
+        const std::tuple<Types...> & tup, std::index_sequence<I...>)
+{
+    ((print_bounded(out, std::get<I>(tup)),
+      out<<(I + 1 < sizeof...(Types) ? delimiter : std::string())), ...);
+}
 
 enum ColorCode {
     RED_COLOR = 1,
@@ -86,13 +215,27 @@ struct ColoredString {
     }
 };
 
+// The stream that properties report to, std::cout unless redirected.
+// It is per thread, so that properties running concurrently (e.g. in a
+// suite) can each report to their own buffer.
+inline std::ostream *& output_stream()
+{
+    static thread_local std::ostream * out = &std::cout;
+    return out;
+}
+
+inline std::ostream & output()
+{
+    return *output_stream();
+}
+
 template<typename... Types>
 void print_tuple(const std::tuple<Types...> & tup, 
-                 std::ostream &out = std::cout,
+                 std::ostream &out = output(),
                  std::string delimiter = ", ") 
 {
     out<<"[";
-    tuple_printer_impl<sizeof...(Types)>()(tuple_printer(out, delimiter), tup);
+    print_elements(out, delimiter, tup, std::index_sequence_for<Types...>());
     out<<"]"<<std::endl;
 }
 
@@ -104,6 +247,22 @@ std::ostream & operator<<(std::ostream & out, const std::tuple<Types...> & tup)
 }
 } // namespace detail
 
+// Limits how much of the inputs is printed, with verbose=2 and in the
+// reports: at most elements elements of a vector, at most depth levels of
+// nested vectors, and at most chars characters of every argument. 0 means
+// no limit. By default, 100 elements, 4 levels and 4096 characters.
+inline void limit_printing(size_t elements, size_t depth = 4, size_t chars = 4096)
+{
+    detail::print_limits() = detail::PrintLimits{elements, depth, chars};
+}
+
+// Saves the failing inputs in full, without the limits of limit_printing,
+// to the file at path, after the reports. An empty path turns it off.
+inline void save_full_inputs(const std::string & path)
+{
+    detail::full_inputs_path() = path;
+}
+
 } // namespace qcppc
 
 #endif // QCPPC_PRINTER_H_
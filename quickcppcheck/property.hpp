@@ -4,11 +4,30 @@
 #include <iostream>
 #include <functional>
 #include <tuple>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <map>
+#include <list>
+#include <future>
+#include <chrono>
+#include <sstream>
+#include <fstream>
+#include <exception>
 
 #include "utils.hpp"
 #include "generator.hpp"
 #include "printer.hpp"
 #include "classifier.hpp"
+#include "hash.hpp"
+#include "cache.hpp"
+#include "pool.hpp"
+#include "perf.hpp"
+#include "baseline.hpp"
+#include "alloc.hpp"
+#include "shard.hpp"
+#include "stats.hpp"
+#include "extension.hpp"
 
 #define QCPP_STRINGIFY(x) #x
 #define QCPP_TOSTRING(x) QCPP_STRINGIFY(x)
@@ -30,50 +49,1086 @@ static detail::ColoredString MAKE_YELLOW = detail::ColoredString(detail::YELLOW_
 # define MAKE_YELLOW(X) (X)
 #endif
 
+namespace detail {
+
+// Prints the report of a property that passed its tests.
+inline void print_passed(std::ostream & out, bool complete, unsigned int ntests,
+        unsigned int discarded, unsigned int tests, size_t combinations,
+        const std::vector<size_t> & enum_sizes)
+{
+    if (complete) {
+        out<<MAKE_GREEN("+++ OK,")<<" exhaustively verified "<<ntests<<" cases";
+        if (discarded) {
+            out<<" ("<<discarded<<" discarded)";
+        }
+        out<<"."<<std::endl;
+    } else if (combinations > 1) {
+        out<<MAKE_GREEN("+++ OK,")<<" passed "<<tests<<" tests, covering all "
+            <<combinations<<" combinations of argument(s)";
+        for (size_t pos = 0;pos < enum_sizes.size();++pos) {
+            if (enum_sizes[pos]) out<<" "<<pos;
+        }
+        out<<"."<<std::endl;
+    } else {
+        out<<MAKE_GREEN("+++ OK,")<<" passed "<<tests<<" tests."<<std::endl;
+    }
+}
+
+// Prints how many of the values drawn by the generators were edge cases,
+// and of which kind.
+inline void print_edges(std::ostream & out, const EdgeCounts & counts)
+{
+    size_t n = 0;
+    for (auto &it:counts.edges) {
+        n += it.second;
+    }
+    out<<"  edge cases: "<<n<<" of "<<counts.values<<" values."<<std::endl;
+    print_classes(out, counts.edges, counts.values);
+}
+
+// Properties that passed the same tests in this build before run with
+// the reduced budget of the result cache, if it is enabled. Returns the
+// number of tests to run and sets key to the key of the property in the
+// cache (empty if disabled). If there is none to run, reports the
+// property as passed.
+inline unsigned int cached_budget(const std::string & name, int verbose,
+        unsigned int ntests, std::string & key, unsigned int & rerun)
+{
+    ResultCache & cache = ResultCache::instance();
+    rerun = 0;
+    if (!cache.enabled()) {
+        return ntests;
+    }
+    key = cache.key(name);
+    unsigned int budget = cache.budget(key, ntests, rerun);
+    if (budget == 0 && verbose > 0) {
+        std::ostream & out = output();
+        out<<"Property: "<<MAKE_YELLOW(name)<<std::endl;
+        out<<MAKE_GREEN("+++ OK,")<<" passed "<<ntests
+            <<" tests (cached)."<<std::endl<<std::endl;
+    }
+    return budget;
+}
+
+// Records the result of a property in the cache.
+inline void record_result(const std::string & key, unsigned int ntests,
+        unsigned int rerun, bool ok)
+{
+    if (!key.empty()) {
+        ResultCache::instance().record(key, ntests, ok, rerun);
+    }
+}
+
+// Chooses the arguments to enumerate: those with the smallest finite
+// domains (sizes, 0 if unknown), as long as all their combinations fit
+// in ntests tests. Sets enum_sizes to the sizes of the chosen arguments,
+// 0 for the rest, and returns the number of combinations.
+inline size_t plan_enumeration(const std::vector<size_t> & sizes,
+        unsigned int ntests, std::vector<size_t> & enum_sizes)
+{
+    std::vector<size_t> order;
+    for (size_t pos = 0;pos < sizes.size();++pos) {
+        if (sizes[pos] > 0) order.push_back(pos);
+    }
+    std::stable_sort(order.begin(), order.end(),
+            [&sizes](size_t a, size_t b) { return sizes[a] < sizes[b]; });
+
+    size_t combinations = 1;
+    enum_sizes.assign(sizes.size(), 0);
+    for (auto pos:order) {
+        if (sizes[pos] > ntests / combinations) break;
+        combinations *= sizes[pos];
+        enum_sizes[pos] = sizes[pos];
+    }
+    return combinations;
+}
+
+// An input as printed in the reports, within the limits of
+// limit_printing, and in full if the failing inputs are saved (see
+// save_full_inputs).
+struct PrintedInput
+{
+    std::string brief;
+    std::string full;
+};
+
+// Appends the full failing input of the property name to the file at path.
+inline void save_full_input(const std::string & path, const std::string & name,
+        const std::string & input)
+{
+    std::ofstream file(path, std::ios::app);
+    file<<"Property: "<<name<<std::endl<<input<<std::endl;
+}
+
+// Storage that is not copied with its owner: a copy starts out value
+// initialized. It keeps the input of the current test of a property,
+// which is generated again for every test, so that properties can be
+// copied even when their arguments can't.
+template<typename T>
+struct Scratch
+{
+    T value;
+
+    Scratch():value() {}
+
+    Scratch(const Scratch &):value() {}
+
+    Scratch(Scratch &&) = default;
+
+    Scratch & operator=(const Scratch &) {
+        value = T();
+        return *this;
+    }
+
+    Scratch & operator=(Scratch &&) = default;
+};
+
+// The bookkeeping of a run.
+struct RunState
+{
+    unsigned int ntests;
+    unsigned int discarded;
+    unsigned int max_discarded;
+    unsigned int duplicates;
+    unsigned int tests;
+    size_t combinations;
+    bool complete;
+    bool exhausted;
+
+    // The test at which the arguments got exhausted.
+    unsigned int exhausted_at;
+
+    // The tests before first are only drawn, not run (see Shards), and
+    // the discarded inputs before it.
+    unsigned int first;
+    unsigned int discarded_before;
+
+    // The first failing test, 0 if none, how its input was printed (in
+    // full, if saved) and why it failed (empty if the property returned
+    // false).
+    unsigned int failed;
+    std::string failed_input;
+    std::string failed_full;
+    std::string reason;
+
+    // Whether the extensions may stop the run early (see
+    // Extension::check), whether they stopped it as passed, and why one
+    // failed the run, if one did.
+    bool early_stop;
+    bool stopped_early;
+    RunFailure failure;
+
+    // The class of the current input, if there is a classifier.
+    std::string label;
+
+    // The test being run, and its input as printed, if it was (see
+    // run_sync). Kept here, so that it outlives an exception of the test.
+    unsigned int current;
+    PrintedInput printed;
+
+    // Whether an extension redraws inputs (see Extension::redraws_input),
+    // and then the engine as it was before the current test.
+    bool redraw;
+    Engine drawn_from;
+};
+
+// The part of a property that doesn't depend on the types of its
+// arguments: the runs, their reports and the extensions, compiled once
+// per translation unit rather than for every Property, which implements
+// the rest on the input.
+class PropertyBase
+{
+public:
+    // Max number of tests to run, if user does not specify.
+    static constexpr unsigned int MAX_TESTS = 1000;
+
+    // The number of discarded tests before giving up.
+    static constexpr float DISCARDED_RATIO = 0.5;
+
+    // The number of tests of an asynchronous property in flight, if the
+    // user does not specify.
+    static constexpr unsigned int DEFAULT_CONCURRENCY = 16;
+
+    // How often (in tests) the extensions look at the run, to stop early.
+    static constexpr unsigned int CHECK_EVERY = 100;
+
+protected:
+    // The coroutine generators, if any, take their frames from here. It
+    // is only made once one is set (see Property::Rnd), and lives in the
+    // base, so that it outlives the generators.
+    std::shared_ptr<FramePool> frame_pool;
+
+    // The random engine the generators draw from while the property runs,
+    // seeded by the name (see property_seed). Copies of the property draw
+    // the same inputs.
+    Engine engine;
+
+    // Description of the property.
+    std::string name;
+
+    // Output verbosity level.
+    int verbose;
+
+    // Whether to enumerate the arguments with small domains, see
+    // Property::Exhaustive.
+    bool exhaustive;
+
+    // For every argument, the size of its domain if it is enumerated,
+    // otherwise 0. Only meaningful while running in exhaustive mode.
+    std::vector<size_t> enum_sizes;
+
+    // Remembers the generated inputs when duplicates are skipped, see
+    // Property::Dedup. Empty (the default) when they are not.
+    std::shared_ptr<BloomFilter> seen;
+    size_t seen_bytes;
+
+    // The parts of the tests that only some properties need, set by the
+    // builders that need them so that the others don't instantiate them
+    // (null otherwise): the drawing of the enumerated or held arguments
+    // (see Property::Exhaustive and Fix), the sizes of their domains, the
+    // restoring of the held ones, the acceptor (see If), the hash of the
+    // input (see Dedup), its class (see Classify), its statistics (see
+    // Collect) and its destruction (see Allocations).
+    void (PropertyBase::*generate_enumerated)(size_t);
+    std::vector<size_t> (PropertyBase::*domain_sizes)();
+    void (PropertyBase::*restore_held)();
+    bool (PropertyBase::*accept_input)();
+    uint64_t (PropertyBase::*hash_input)();
+    std::string (PropertyBase::*classify_input)();
+    void (PropertyBase::*collect_input)();
+    void (PropertyBase::*reset_input)();
+
+    // The statistics of the last run, see Property::Collect.
+    std::shared_ptr<Statistics> stats;
+
+    // The share of edge cases in the values of the generators, see
+    // Property::Edges, and the edge cases of the last run.
+    double edge_rate;
+    std::shared_ptr<EdgeCounts> edge_counts;
+
+    // The number of processes to run the tests in, see Property::Shards,
+    // 0 if not set.
+    unsigned int shards;
+
+    // How many tests of an asynchronous property may run at once, and how
+    // they run, null for synchronous properties. Only the asynchronous
+    // constructor sets it, so that other properties don't instantiate it.
+    unsigned int concurrency;
+    bool (PropertyBase::*run_async)(RunState &);
+
+    // Whether some arguments are moved into the property function, and so
+    // the input has to be printed before the call to be reported.
+    bool moves_input;
+
+    // The opt-in features that hook into the tests, see extension.hpp.
+    Extensions extensions;
+
+    PropertyBase(const std::string & name, int verbose, bool moves_input):
+        engine(make_engine(property_seed(name))), name(name), verbose(verbose),
+        exhaustive(false), seen_bytes(0), generate_enumerated(nullptr),
+        domain_sizes(nullptr), restore_held(nullptr), accept_input(nullptr),
+        hash_input(nullptr), classify_input(nullptr), collect_input(nullptr),
+        reset_input(nullptr),
+        edge_rate(default_edge_rate()), shards(0), concurrency(DEFAULT_CONCURRENCY),
+        run_async(nullptr), moves_input(moves_input)
+    {}
+
+    virtual ~PropertyBase() {}
+
+    // f, a member function of a Property, as a hook of the base.
+    template<typename R, typename P, typename... Params>
+    static auto hook(R (P::*f)(Params...)) -> R (PropertyBase::*)(Params...)
+    {
+        return static_cast<R (PropertyBase::*)(Params...)>(f);
+    }
+
+    // The input of the property, see Property.
+    virtual void generate_input() = 0;
+    virtual void print_input(std::ostream & out) = 0;
+    virtual bool call_input() = 0;
+
+    // The counts of the classes, see Property::Classify.
+    virtual ClassCounts & class_counts() = 0;
+
+    // The input of the current test, as the extensions see it.
+    class CurrentInput : public TestInput
+    {
+    private:
+        PropertyBase & property;
+        RunState & st;
+
+    public:
+        // The input as printed, if it was.
+        PrintedInput & printed;
+
+        // Whether the input was destroyed since it was drawn.
+        bool destroyed;
+
+        CurrentInput(PropertyBase & property, RunState & st):
+            property(property), st(st), printed(st.printed), destroyed(false) {}
+
+        std::string print() override {
+            if (!property.moves_input) {
+                if (destroyed && st.redraw) {
+                    property.redraw(st);
+                    destroyed = false;
+                }
+                printed = property.printed_input();
+            }
+            return printed.brief;
+        }
+
+        void destroy() override {
+            (property.*property.reset_input)();
+            destroyed = true;
+        }
+    };
+
+    RunCounts run_counts(const RunState & st) {
+        ClassCounts & counts = class_counts();
+        return RunCounts{st.tests, &counts.classes, counts.total};
+    }
+
+    void print_classifier_result() {
+        if (classify_input) {
+            print_classes(output(), class_counts().classes, class_counts().total);
+        }
+    }
+
+    void print_edges_result() {
+        if (edge_counts && !edge_counts->edges.empty()) {
+            print_edges(output(), *edge_counts);
+        }
+    }
+
+    void print_stats_result() {
+        if (stats) {
+            stats->print_results(output());
+        }
+    }
+
+    void print_duplicates_result(unsigned int duplicates, unsigned int ntests) {
+        if (seen_bytes) {
+            output()<<"  "<<std::floor(1000.0 * duplicates / ntests) / 10
+                <<"% of the inputs were duplicates and skipped ("<<duplicates<<")."<<std::endl;
+        }
+    }
+
+    // What is reported of the tests, after the headline.
+    void print_results(unsigned int duplicates, unsigned int ntests) {
+        print_classifier_result();
+        print_edges_result();
+        print_stats_result();
+        extensions.each([](const Extension & e) { e.print_results(output()); });
+        print_duplicates_result(duplicates, ntests);
+    }
+
+    // Generates the data of a test. The enumerated arguments, if any,
+    // take the values of the given combination, the rest are random.
+    void generate(size_t combination)
+    {
+        if (!run_async) {
+            extensions.each([](Extension & e) { e.begin_generation(); });
+        }
+        draw_input(combination);
+        if (!run_async) {
+            extensions.each_reversed([](Extension & e) { e.end_generation(); });
+        }
+    }
+
+    void draw_input(size_t combination)
+    {
+        if (generate_enumerated) {
+            (this->*generate_enumerated)(combination);
+        } else {
+            generate_input();
+        }
+    }
+
+    // Draws the input of the current test again, as draw did, from the
+    // engine as it was before the test. The edge cases are not counted
+    // again, and the engine is left as it was.
+    void redraw(RunState & st)
+    {
+        Engine after = engine;
+        engine = st.drawn_from;
+        EdgeScope edge_scope(edge_context().rate, nullptr);
+        size_t combination = (st.current - 1) % st.combinations;
+        do {
+            draw_input(combination);
+        } while (accept_input && !(this->*accept_input)());
+        engine = after;
+    }
+
+    // An input, printed by print, as in the reports.
+    static PrintedInput printed(const std::function<void(std::ostream &)> & print)
+    {
+        PrintedInput printed;
+        std::ostringstream brief;
+        print(brief);
+        printed.brief = brief.str();
+        if (!full_inputs_path().empty()) {
+            UnlimitedPrinting unlimited;
+            std::ostringstream full;
+            print(full);
+            printed.full = full.str();
+        }
+        return printed;
+    }
+
+    PrintedInput printed_input()
+    {
+        return printed([this](std::ostream & out) { print_input(out); });
+    }
+
+    enum DrawResult { DRAWN, SKIPPED, EXHAUSTED };
+
+    // Generates the data of the i-th test, drawing again while it is not
+    // accepted. Inputs seen before (see Dedup) and, when all the inputs
+    // are enumerated, rejected ones are skipped. Tests before st.first are
+    // only drawn (they are SKIPPED), to get to the same inputs as if they
+    // ran.
+    DrawResult draw(unsigned int i, RunState & st)
+    {
+        std::ostream & out = output();
+        bool replay = i < st.first;
+
+        // The edge cases of the inputs that are only drawn don't count.
+        edge_context().counts = replay ? nullptr : edge_counts.get();
+        size_t combination = (i - 1) % st.combinations;
+        generate(combination);
+
+        while (accept_input && !(this->*accept_input)()) {
+            ++st.discarded;
+            if (st.complete) {
+                return SKIPPED;
+            }
+            if (st.discarded == st.max_discarded) {
+                st.exhausted = true;
+                st.exhausted_at = i;
+                return EXHAUSTED;
+            }
+            generate(combination);
+        }
+
+        if (seen && !seen->insert((this->*hash_input)())) {
+            if (!replay) ++st.duplicates;
+            return SKIPPED;
+        }
+        if (replay) {
+            return SKIPPED;
+        }
+        ++st.tests;
+
+        if (classify_input) {
+            st.label = (this->*classify_input)();
+        }
+        if (collect_input) {
+            (this->*collect_input)();
+        }
+        if (verbose > 1) {
+            out<<i<<": ";
+            print_input(out);
+            out.flush();
+        }
+        return DRAWN;
+    }
+
+    void print_exhausted(const RunState & st)
+    {
+        if (verbose > 0) {
+            std::ostream & out = output();
+            out<<MAKE_RED("!!! Arguments exhausted")<<" after "
+                <<st.exhausted_at<<" tests and "
+                <<st.discarded<<" discarded inputs."<<std::endl;
+            print_classifier_result();
+            print_edges_result();
+            print_stats_result();
+            out<<std::endl;
+        }
+    }
+
+    void print_falsified(const RunState & st)
+    {
+        if (verbose > 0) {
+            std::ostream & out = output();
+            out<<MAKE_RED("*** Falsifiable,")<<" after "<<st.failed<<" tests";
+            if (!st.reason.empty()) {
+                out<<", "<<st.reason<<std::endl;
+            } else {
+                out<<"."<<std::endl;
+            }
+            if (verbose > 1) {
+                out<<st.failed<<": ";
+            }
+            out<<st.failed_input;
+            if (!st.failed_full.empty()) {
+                save_full_input(full_inputs_path(), name, st.failed_full);
+                out<<"  full input saved to "<<full_inputs_path()<<"."<<std::endl;
+            }
+            print_results(st.duplicates, st.failed);
+        }
+    }
+
+    // Records the i-th test, whose input was printed as input, as the first
+    // failing one.
+    void set_failed(RunState & st, unsigned int i, const PrintedInput & input,
+            const std::string & reason = std::string())
+    {
+        st.failed = i;
+        st.failed_input = input.brief;
+        st.failed_full = input.full;
+        st.reason = reason;
+    }
+
+    // Records the current test as the first failing one, since it threw
+    // what: a worker can't pass the exception on to the parent.
+    void set_thrown(RunState & st, const std::string & what)
+    {
+        PrintedInput input = moves_input ? st.printed : printed_input();
+        if (input.brief.empty()) {
+            input.brief = "(unknown input)\n";
+        }
+        set_failed(st, st.current, input, "threw " + what + ".");
+    }
+
+    // Lets the extensions look at the run so far, see Extension::check.
+    CheckResult check_extensions(RunState & st)
+    {
+        RunCounts counts = run_counts(st);
+        CheckResult result = CHECK_UNDECIDED;
+        extensions.each([&](Extension & e) {
+                    if (result != CHECK_FAILED) {
+                        CheckResult r = e.check(counts, st.failure);
+                        if (r != CHECK_UNDECIDED) result = r;
+                    } });
+        return result;
+    }
+
+    // Runs the tests one after the other, from st.first to st.ntests.
+    bool run_sync(RunState & st)
+    {
+        for (unsigned int i = 1; i <= st.ntests; ++i) {
+            if (i == st.first) {
+                st.discarded_before = st.discarded;
+            }
+            st.current = i;
+            st.printed = PrintedInput();
+            CurrentInput input(*this, st);
+            if (i >= st.first) {
+                extensions.each([&input](Extension & e) { e.begin_test(input); });
+            }
+            if (st.redraw) {
+                st.drawn_from = engine;
+            }
+            DrawResult drawn = draw(i, st);
+            if (drawn == EXHAUSTED) {
+                return false;
+            }
+            if (drawn == SKIPPED) {
+                continue;
+            }
+            input.destroyed = false;
+            // An input that is moved in is printed now, any other only if
+            // it is reported.
+            if (moves_input) {
+                input.printed = printed_input();
+            }
+            extensions.each([](Extension & e) { e.begin_call(); });
+            bool passed = call_input();
+            extensions.each_reversed([&st](Extension & e) { e.end_call(st.label); });
+            if (!passed) {
+                set_failed(st, i, moves_input ? input.printed : printed_input());
+                return false;
+            }
+            std::string reason;
+            extensions.each([&](Extension & e) {
+                        if (reason.empty()) reason = e.end_test(input); });
+            if (!reason.empty()) {
+                set_failed(st, i, input.printed, reason);
+                return false;
+            }
+            if (st.early_stop && st.tests % CHECK_EVERY == 0) {
+                CheckResult result = check_extensions(st);
+                if (result == CHECK_PASSED) {
+                    st.stopped_early = true;
+                    return true;
+                }
+                if (result == CHECK_FAILED) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Runs the tests from first to last in a worker, see Shards.
+    ShardResult run_shard(RunState st, unsigned int first, unsigned int last)
+    {
+        std::ostringstream text;
+        std::ostream * previous = output_stream();
+        output_stream() = &text;
+        st.first = first;
+        st.ntests = last;
+        try {
+            run_sync(st);
+        } catch (const std::exception & e) {
+            set_thrown(st, e.what());
+        } catch (...) {
+            set_thrown(st, "an unknown exception");
+        }
+        output_stream() = previous;
+
+        ShardResult r;
+        r.tests = st.tests;
+        r.discarded = st.discarded - st.discarded_before;
+        r.duplicates = st.duplicates;
+        r.failed = st.failed;
+        r.input = st.failed_input;
+        r.full = st.failed_full;
+        r.reason = st.reason;
+        r.exhausted_at = st.exhausted ? st.exhausted_at : 0;
+        r.text = text.str();
+        r.classes = class_counts().classes;
+        r.edge_values = edge_counts->values;
+        r.edges = edge_counts->edges;
+        r.stats = stats->encode();
+        return r;
+    }
+
+    // Whether an extension prefers the tests to run in one process, see
+    // Extension::prefers_one_process.
+    bool prefers_one_process() const
+    {
+        bool one = false;
+        extensions.each([&one](const Extension & e) { one = one || e.prefers_one_process(); });
+        return one;
+    }
+
+    // The number of processes to run the tests in: the one set with Shards,
+    // else QCPPC_SHARDS unless the property uses Perf, Baseline or Cover,
+    // which sharding turns off. Asynchronous properties, and those of
+    // threads that must not fork (see forking_disabled), run in this
+    // process.
+    unsigned int shard_count() const
+    {
+        if (run_async || forking_disabled()) {
+            return 1;
+        }
+        if (shards) {
+            return shards;
+        }
+        return prefers_one_process() ? 1 : default_shards();
+    }
+
+    // Runs the tests in shards worker processes and merges their results,
+    // up to the first worker that failed.
+    bool run_sharded(RunState & st)
+    {
+        std::vector<ShardResult> results = run_shards(shard_count(), st.ntests,
+                [this, &st](unsigned int first, unsigned int last) {
+                    return run_shard(st, first, last); });
+        for (auto &r:results) {
+            if (!r.delivered) {
+                st.failed = r.first;
+                st.failed_input = "(unknown input)\n";
+                st.reason = r.error + ".";
+                return false;
+            }
+            output()<<r.text;
+            st.tests += r.tests;
+            st.discarded += r.discarded;
+            st.duplicates += r.duplicates;
+            class_counts().add(r.classes);
+            edge_counts->values += r.edge_values;
+            for (auto &it:r.edges) {
+                edge_counts->edges[it.first] += it.second;
+            }
+            stats->merge_encoded(r.stats);
+            if (r.exhausted_at) {
+                st.exhausted = true;
+                st.exhausted_at = r.exhausted_at;
+                return false;
+            }
+            if (r.failed) {
+                st.failed = r.failed;
+                st.failed_input = r.input;
+                st.failed_full = r.full;
+                st.reason = r.reason;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Runs the tests, see operator().
+    bool run(unsigned int ntests, float discarded_ratio)
+    {
+        std::ostream & out = output();
+        if (restore_held) {
+            (this->*restore_held)();
+        }
+        FramePoolScope pool_scope(frame_pool.get());
+        EngineScope engine_scope(&engine);
+        stats = std::make_shared<Statistics>();
+        StatisticsScope stats_scope(stats.get());
+        edge_counts = std::make_shared<EdgeCounts>();
+        EdgeScope edge_scope(edge_rate, edge_counts.get());
+
+        RunState st;
+        st.discarded = 0;
+        st.max_discarded = discarded_ratio * ntests;
+        st.duplicates = 0;
+        st.tests = 0;
+        st.exhausted = false;
+        st.exhausted_at = 0;
+        st.first = 1;
+        st.discarded_before = 0;
+        st.failed = 0;
+        st.stopped_early = false;
+        st.current = 0;
+
+        if (seen_bytes) {
+            seen = std::make_shared<BloomFilter>(seen_bytes);
+        }
+        bool sharded = shard_count() > 1;
+        st.early_stop = !sharded && !run_async && !extensions.empty();
+        if (sharded && prefers_one_process()) {
+            std::cerr<<"Test warning: "<<name<<": ";
+            std::cerr<<"Shards turns off Perf, Baseline and the early stop of Cover."<<std::endl;
+        }
+        bool async = run_async != nullptr;
+        bool classified = classify_input != nullptr;
+        extensions.each([&](Extension & e) {
+                    e.begin_run(name, async, sharded, classified); });
+        st.redraw = false;
+        extensions.each([&st](const Extension & e) {
+                    st.redraw = st.redraw || e.redraws_input(); });
+
+        st.combinations = exhaustive ?
+            plan_enumeration((this->*domain_sizes)(), ntests, enum_sizes) : 1;
+        st.complete = exhaustive && std::find(enum_sizes.begin(),
+                enum_sizes.end(), 0) == enum_sizes.end();
+        st.ntests = st.complete ? st.combinations : ntests;
+
+        if (verbose > 1) {
+            out<<"[--------start test--------]"<<std::endl;
+        }
+        if (verbose > 0) {
+            out<<"Property: "<<MAKE_YELLOW(name)<<std::endl;
+        }
+
+        bool ok = run_async ? (this->*run_async)(st) :
+            sharded ? run_sharded(st) : run_sync(st);
+        if (st.exhausted) {
+            print_exhausted(st);
+            return false;
+        }
+        if (st.failed) {
+            print_falsified(st);
+        }
+        if (ok) {
+            RunCounts counts = run_counts(st);
+            extensions.each([&](Extension & e) {
+                        if (ok) ok = e.end_run(counts, st.failure); });
+        }
+
+        if (verbose > 0 && ok) {
+            print_passed(out, st.complete, st.ntests, st.discarded, st.tests,
+                    st.combinations, enum_sizes);
+            print_results(st.duplicates, st.ntests);
+        } else if (verbose > 0 && !st.failure.title.empty()) {
+            out<<MAKE_RED("*** " + st.failure.title + ",")<<" "<<st.failure.detail<<std::endl;
+            print_results(st.duplicates, st.tests);
+        }
+        if (verbose > 1) {
+            out<<"[--------end test------]"<<std::endl;
+        }
+        if (verbose > 0) {
+            out<<std::endl;
+        }
+        return ok;
+    }
+
+public:
+    // Executes the tests until we reach ntests successful tests
+    // or the test fails or we reach discarded_ratio * ntests discarded tests.
+    //
+    // In exhaustive mode, if all the arguments could be enumerated, runs
+    // each of their combinations exactly once instead; combinations that
+    // are not accepted are just skipped.
+    bool operator()(unsigned int ntests = MAX_TESTS,
+            float discarded_ratio = DISCARDED_RATIO)
+    {
+        std::string cache_key;
+        unsigned int rerun;
+        unsigned int budget = cached_budget(name, verbose, ntests, cache_key, rerun);
+        if (budget == 0) {
+            return true;
+        }
+        if (rerun) {
+            // The full run already passed the first inputs.
+            engine = make_engine(property_seed(name, rerun));
+        }
+        bool ok = run(budget, discarded_ratio);
+        record_result(cache_key, ntests, rerun, ok);
+        return ok;
+    }
+};
+
+} // namespace detail
+
 // An object of class Property contains the execution environment of a property.
 // That is, the property function itself and the data generators and constraints
-// on these data.
+// on these data. The runs are in detail::PropertyBase; this class implements
+// them on the input, which depends on the types of the arguments.
 template<typename... Args>
-class Property
+class Property : public detail::PropertyBase
 {
 private:
-    // The data to supply to property function.
-    std::tuple<typename std::decay<Args>::type...> data;
+    typedef std::tuple<typename std::decay<Args>::type...> DataType;
+
+    // The data to supply to property function. It is not copied with the
+    // property, see detail::Scratch.
+    detail::Scratch<DataType> data;
 
     // Generators for data. Each generator provides a value of type T,
     // where T is the type of the corresponding position in member data.
     std::tuple<Generator<typename std::decay<Args>::type>...> generators;
 
-    typedef std::function<bool(Args&...)> FunType;
+    // The arguments are passed as in passed_type: the generated values are
+    // moved in, rather than copied, when they can't be copied.
+    typedef std::function<bool(typename passed_type<Args>::type...)> FunType;
+    typedef std::function<std::future<bool>(typename passed_type<Args>::type...)>
+        AsyncFunType;
     typedef std::function<bool(Args&...)> AcceptorType;
     typedef typename Classifier<Args...>::classifier_type ClassifierType;
+    typedef std::function<double(Args&...)> CollectorType;
 
     // The property function.
     FunType prop_fun;
 
+    // The property function of asynchronous properties, instead of
+    // prop_fun. Held by pointer, so that other properties don't
+    // instantiate its type.
+    std::shared_ptr<AsyncFunType> async_fun;
+
     // The acceptor function.
     AcceptorType acceptor;
 
     Classifier<typename std::decay<Args>::type...> classifier;
 
-    // Description of the property.
-    std::string name;
+    // The statistics to collect from every input, see Collect.
+    std::vector<std::pair<std::string, CollectorType>> collectors;
 
-    // Output verbosity level.
-    int verbose;
+    // The positions in the domains of the enumerated arguments for the
+    // current test, NOT_ENUMERATED for the random ones and KEPT for the
+    // held ones.
+    std::vector<size_t> enum_index;
 
-    // Max number of tests to run, if user does not specify.
-    static constexpr unsigned int MAX_TESTS = 1000;
+    // For every argument, whether its value is held in data across the
+    // tests instead of generated for each, see Fix.
+    std::vector<bool> held;
 
-    // The number of discarded tests before giving up.
-    static constexpr float DISCARDED_RATIO = 0.5;
+    static constexpr bool MOVES_INPUT = (moved_in<Args>::value || ... || false);
 
-    void print_classifier_result() {
-        if (classifier) {
-            classifier.print_results();
+    void generate_input() override
+    {
+        apply_func_individually(generators, data.value);
+    }
+
+    // Set by Exhaustive and Fix.
+    void generate_enumerated_input(size_t combination)
+    {
+        enum_index.assign(held.size(), NOT_ENUMERATED);
+        for (size_t pos = 0;pos < enum_sizes.size() && exhaustive;++pos) {
+            if (enum_sizes[pos]) {
+                enum_index[pos] = combination % enum_sizes[pos];
+                combination /= enum_sizes[pos];
+            }
+        }
+        for (size_t pos = 0;pos < held.size();++pos) {
+            if (held[pos]) enum_index[pos] = KEPT;
+        }
+        enumerate_individually(generators, data.value, enum_index);
+    }
+
+    // Set by If.
+    bool accept_data()
+    {
+        return apply_func(acceptor, data.value);
+    }
+
+    // Set as the hash of the inputs by Dedup.
+    uint64_t hash_data()
+    {
+        return detail::tuple_hash(data.value);
+    }
+
+    // Set by Collect.
+    void collect_data()
+    {
+        for (auto &c:collectors) {
+            stats->add(c.first, apply_func(c.second, data.value));
+        }
+    }
+
+    void print_input(std::ostream & out) override
+    {
+        out<<data.value;
+    }
+
+    // Set by Exhaustive.
+    std::vector<size_t> domain_sizes_of_generators()
+    {
+        return utils::domain_sizes(generators);
+    }
+
+    bool call_input() override
+    {
+        return call(prop_fun, data.value);
+    }
+
+    // Set by Classify.
+    std::string classify_data()
+    {
+        return classifier.classify(data.value);
+    }
+
+    detail::ClassCounts & class_counts() override
+    {
+        return classifier.counts();
+    }
+
+    // Calls f (the property function) with the input.
+    template<typename F, size_t... I>
+    decltype(auto) call(F & f, DataType & input, std::index_sequence<I...>)
+    {
+        return f(static_cast<typename passed_type<Args>::type>(std::get<I>(input))...);
+    }
+
+    template<typename F>
+    decltype(auto) call(F & f, DataType & input)
+    {
+        return call(f, input, std::index_sequence_for<Args...>());
+    }
+
+    // Moves the input of the current test out of data. The held arguments
+    // are given their values again.
+    DataType take_input()
+    {
+        DataType input(std::move(data.value));
+        if (restore_held) {
+            restore_held_input();
+        }
+        return input;
+    }
+
+    // Set by Fix.
+    void restore_held_input()
+    {
+        restore_held_at(std::index_sequence_for<Args...>());
+    }
+
+    template<size_t... I>
+    void restore_held_at(std::index_sequence<I...>)
+    {
+        ((held[I] ? void(std::get<I>(data.value) = std::get<I>(generators)()) : void()), ...);
+    }
+
+    // Destroys the inputs of the last test, except the held ones. Set by
+    // Allocations, NoLeaks and MaxAllocations.
+    void destroy_data()
+    {
+        reset_data(std::index_sequence_for<Args...>());
+    }
+
+    template<size_t... I>
+    void reset_data(std::index_sequence<I...>)
+    {
+        (reset_one(std::get<I>(data.value), held[I]), ...);
+    }
+
+    // Swapped out rather than assigned, since assignments may keep the
+    // buffers.
+    template<typename T>
+    static void reset_one(T & t, bool keep)
+    {
+        if (!keep) {
+            T empty{};
+            std::swap(t, empty);
         }
     }
 
+    static detail::PrintedInput printed(const DataType & input)
+    {
+        return PropertyBase::printed([&input](std::ostream & out) { out<<input; });
+    }
+
+    // The allocation accounting, made if there is none yet.
+    detail::AllocExtension & allocations()
+    {
+        reset_input = hook(&Property::destroy_data);
+        return extensions.get_or_make<detail::AllocExtension>(detail::ALLOC_EXTENSION);
+    }
+
+    // A test of an asynchronous property that is still running, and its
+    // input as printed before the call if it is moved in.
+    struct Pending
+    {
+        unsigned int i;
+        DataType input;
+        detail::PrintedInput printed;
+        std::future<bool> result;
+
+        Pending(unsigned int i, DataType && input):i(i), input(std::move(input)) {}
+    };
+
+    // Runs the tests of an asynchronous property, up to concurrency of
+    // them at a time. The inputs are generated in the same order as for
+    // a synchronous property, and when a test fails, all the tests before
+    // it are waited for, so that the first failing input is reported.
+    bool run_async_tests(detail::RunState & st)
+    {
+        std::list<Pending> pending;
+
+        unsigned int i = 1;
+        while (true) {
+            while (!st.failed && !st.exhausted && i <= st.ntests &&
+                    pending.size() < concurrency) {
+                DrawResult drawn = draw(i, st);
+                if (drawn == DRAWN) {
+                    pending.emplace_back(i, take_input());
+                    Pending & p = pending.back();
+                    if (MOVES_INPUT) {
+                        p.printed = printed(p.input);
+                    }
+                    p.result = call(*async_fun, p.input);
+                }
+                ++i;
+            }
+            if (pending.empty()) {
+                break;
+            }
+
+            // Collects a finished test, if there is one, or else blocks on
+            // the oldest one. A deferred future only runs when asked for its
+            // result, so it counts as finished.
+            auto done = std::find_if(pending.begin(), pending.end(), [](Pending & p) {
+                        return p.result.wait_for(std::chrono::seconds(0)) !=
+                            std::future_status::timeout; });
+            if (done == pending.end()) {
+                done = pending.begin();
+            }
+            if (!done->result.get() && (!st.failed || done->i < st.failed)) {
+                set_failed(st, done->i, MOVES_INPUT ? done->printed : printed(done->input));
+            }
+            pending.erase(done);
+        }
+
+        return !st.exhausted && !st.failed;
+    }
+
 public:
     // Constructs a Property object around the function prop_fun.
     //
@@ -90,89 +1145,38 @@ public:
     //  2: print also all the generated test cases.
     Property(const FunType & prop_fun, const std::string & name =
             std::string("<unnamed>"), int verbose = 1):
+        PropertyBase(name, verbose, MOVES_INPUT),
         prop_fun(prop_fun), acceptor(nullptr), classifier(nullptr),
-        name(name), verbose(verbose)
+        held(sizeof...(Args), false)
     {}
 
-    // Executes the tests until we reach ntests successful tests
-    // or the test fails or we reach discarded_ratio * ntests discarded tests.
-    bool operator()(unsigned int ntests = MAX_TESTS,
-            float discarded_ratio = DISCARDED_RATIO)
+    // Constructs an asynchronous property, whose function returns an
+    // std::future<bool> instead of a bool. Several of its tests run at
+    // once, see Concurrency.
+    Property(const AsyncFunType & async_fun, const std::string & name =
+            std::string("<unnamed>"), int verbose = 1):
+        PropertyBase(name, verbose, MOVES_INPUT),
+        prop_fun(nullptr), async_fun(std::make_shared<AsyncFunType>(async_fun)),
+        acceptor(nullptr), classifier(nullptr),
+        held(sizeof...(Args), false)
     {
-        bool ok = true;
-        unsigned int discarded = 0;
-        unsigned int max_discarded = discarded_ratio * ntests;
-
-        if (verbose > 1) {
-            std::cout<<"[--------start test--------]"<<std::endl;
-        }
-        if (verbose > 0) {
-            std::cout<<"Property: "<<MAKE_YELLOW(name)<<std::endl;
-        }
-
-        for (unsigned int i = 1; i <= ntests; ++i) {
-            apply_func_individually<sizeof...(Args)>::apply(generators, data);
-
-            if (acceptor) {
-                while (!apply_func<sizeof...(Args)>::apply(acceptor, data)) {
-                    if (++discarded == max_discarded) {
-                        if (verbose > 0) {
-                            std::cout<<MAKE_RED("!!! Arguments exhausted")<<" after "
-                                <<i<<" tests and "
-                                <<discarded<<" discarded inputs."<<std::endl;
-                            print_classifier_result();
-                            std::cout<<std::endl;
-                            return false;
-                        }
-                    }
-                    apply_func_individually<sizeof...(Args)>::apply(generators, data);
-                }
-            }
-
-            if (classifier) {
-                classifier.classify(data);
-            }
-            if (verbose > 1) {
-                std::cout<<i<<": ";
-                std::cout<<data;
-                std::cout.flush();
-            }
-            if (!apply_func<sizeof...(Args)>::apply(prop_fun, data)) {
-                if (verbose > 0) {
-                    std::cout<<MAKE_RED("*** Falsifiable,")<<" after "<<i<<" tests."<<std::endl;
-                    if (verbose > 1) {
-                        std::cout<<i<<": ";
-                    }
-                    std::cout<<data;
-                    print_classifier_result();
-                }
-                ok = false;
-                break;
-            }
-        }
-
-        if (ok) {
-            if (verbose > 0) {
-                std::cout<<MAKE_GREEN("+++ OK,")<<" passed "<<ntests<<" tests."<<std::endl;
-                print_classifier_result();
-            }
-        }
-        if (verbose > 1) {
-            std::cout<<"[--------end test------]"<<std::endl;
-        }
-        if (verbose > 0) {
-            std::cout<<std::endl;
-        }
-        return ok;
+        run_async = hook(&Property::run_async_tests);
     }
 
     // Sets the function fun as the generator for the argument at posistion POS.
+    // The function may be one that can't be copied, see Generator.
     template<size_t POS, typename ValType =
                 typename get_type_at<POS, Args...>::type,
             typename T = std::function<ValType()>>
-    Property<Args...> & Rnd(const T & fun)
+    Property<Args...> & Rnd(T && fun)
     {
-        std::get<POS>(generators) = Generator<ValType>(fun);
+        if constexpr (detail::uses_frame_pool<typename std::decay<T>::type>::value) {
+            if (!frame_pool) {
+                frame_pool = std::make_shared<detail::FramePool>();
+            }
+        }
+        held[POS] = false;
+        std::get<POS>(generators) = Generator<ValType>(std::forward<T>(fun));
         return *this;
     }
 
@@ -183,17 +1187,28 @@ public:
     Property<Args...> & Rnd(Params...params)
     {
         typedef typename get_type_at<POS, Args...>::type ValType;
+        held[POS] = false;
         std::get<POS>(generators) = Arbitrary<ValType>(std::forward<Params>(params)...);
         return *this;
     }
 
     // Creates a Fixed generator with the given value and assigns it
     // to argument position POS.
+    //
+    // Unless the property function takes the argument by non-const
+    // reference, and so may change it, the value is not copied for every
+    // test: it is held in place and the function gets a reference to it.
     template<size_t POS, typename ValType =
                 typename get_type_at<POS, Args...>::type>
     Property<Args...> & Fix(const ValType &v)
     {
+        typedef typename std::tuple_element<POS, std::tuple<Args...>>::type ArgType;
         std::get<POS>(generators) = Fixed<ValType>(v);
+        generate_enumerated = hook(&Property::generate_enumerated_input);
+        restore_held = hook(&Property::restore_held_input);
+        held[POS] = !std::is_reference<ArgType>::value ||
+            (std::is_lvalue_reference<ArgType>::value &&
+             std::is_const<typename std::remove_reference<ArgType>::type>::value);
         return *this;
     }
 
@@ -202,6 +1217,7 @@ public:
                 typename get_type_at<POS, Args...>::type>
     Property<Args...> & One(const std::vector<ValType> &v)
     {
+        held[POS] = false;
         std::get<POS>(generators) = OneOf<ValType>(v);
         return *this;
     }
@@ -211,6 +1227,7 @@ public:
                 typename get_type_at<POS, Args...>::type>
     Property<Args...> & Frq(const std::map<ValType, double> &v)
     {
+        held[POS] = false;
         std::get<POS>(generators) = Freq<ValType>(v);
         return *this;
     }
@@ -219,6 +1236,165 @@ public:
     Property<Args...> & If(const AcceptorType & acceptor)
     {
         this->acceptor = acceptor;
+        accept_input = acceptor ? hook(&Property::accept_data) : nullptr;
+        return *this;
+    }
+
+    // Enables the exhaustive mode. Arguments whose generators have a small
+    // finite domain (bool, Arbitrary<IntType>(low, high) for small ranges,
+    // One, Frq and Fix) are enumerated instead of sampled, as long as all
+    // their combinations fit in the number of tests. Frq weights are
+    // ignored for enumerated arguments. If every argument is enumerated,
+    // each combination runs exactly once and the property is reported as
+    // exhaustively verified; otherwise the tests cycle through the
+    // combinations while the other arguments stay random.
+    Property<Args...> & Exhaustive(bool exhaustive = true)
+    {
+        this->exhaustive = exhaustive;
+        generate_enumerated = hook(&Property::generate_enumerated_input);
+        domain_sizes = hook(&Property::domain_sizes_of_generators);
+        return *this;
+    }
+
+    // Skips generated inputs that were already tested. Inputs are hashed
+    // (see class template Hash) into a Bloom filter of the given size in
+    // bytes, so memory stays fixed however many tests run; the filter may
+    // rarely take a new input for a duplicate, when it gets too full.
+    // Skipped inputs still count towards the number of tests to run, and
+    // the share of them is reported with the result.
+    Property<Args...> & Dedup(size_t bytes = 1 << 20)
+    {
+        static_assert(detail::all_hashable<typename std::decay<Args>::type...>::value,
+                "Dedup: Hash is not specialized for all the argument types");
+        seen_bytes = bytes;
+        hash_input = hook(&Property::hash_data);
+        return *this;
+    }
+
+    // Measures every call of the property function: its time and, where
+    // the hardware counters are available, its cycles, instructions, cache
+    // misses and branch misses. The averages are reported per property and
+    // per class (see Classify). Not supported for asynchronous properties.
+    Property<Args...> & Perf(bool enable = true)
+    {
+        extensions.set(detail::PERF_EXTENSION,
+                enable ? std::make_unique<detail::PerfExtension>() : nullptr);
+        return *this;
+    }
+
+    // Compares the time of the calls of the property function with the
+    // baseline kept for the property in the file at path, and fails if
+    // the median call got slower by more than margin (e.g. 0.1 for 10%)
+    // and a Mann-Whitney U test finds the difference significant.
+    // The first run records the baseline; it is replaced when the
+    // environment variable QCPPC_UPDATE_BASELINES is 1.
+    // Not supported for asynchronous properties.
+    Property<Args...> & Baseline(const std::string & path = ".qcppc_baselines",
+            double margin = 0.1)
+    {
+        detail::BaselineExtension & baseline =
+            extensions.get_or_make<detail::BaselineExtension>(detail::BASELINE_EXTENSION);
+        baseline.baselines = detail::Baselines::open(path);
+        baseline.margin = margin;
+        return *this;
+    }
+
+    // Counts the allocations of every test (see alloc.hpp, which needs
+    // QCPPC_COUNT_ALLOCATIONS defined in one source file): those of the
+    // property function and those of the generation of its input apart.
+    // The averages per test and the inputs with the highest peak memory in
+    // the property function are reported. Not supported for asynchronous
+    // properties.
+    Property<Args...> & Allocations(bool enable = true)
+    {
+        if (!enable) {
+            extensions.set(detail::ALLOC_EXTENSION, nullptr);
+        } else {
+            allocations();
+        }
+        return *this;
+    }
+
+    // Counts the allocations of every test, and fails if one leaks: if,
+    // once its input is destroyed, objects allocated while generating it
+    // or in the property function are still alive.
+    Property<Args...> & NoLeaks()
+    {
+        allocations().check_leaks = true;
+        return *this;
+    }
+
+    // Counts the allocations of every test, and fails if the property
+    // function allocates more than n times in one.
+    Property<Args...> & MaxAllocations(size_t n)
+    {
+        allocations().max_allocations = n;
+        return *this;
+    }
+
+    // Runs the tests in n worker processes, each a contiguous slice of
+    // them, and merges their results: the report is the same as if a
+    // single process had run them, as long as the inputs don't depend on
+    // what the tests before did. Helps with code that keeps global state or
+    // isn't thread-safe, and a worker that crashes fails the property.
+    // Perf, Baseline, the report of Allocations and the early stop of Cover
+    // are not supported (NoLeaks and MaxAllocations are), nor are
+    // asynchronous properties. The tests run in this process when called
+    // from a thread that runs alongside others, such as a worker of
+    // run_suite. The default is the environment variable QCPPC_SHARDS, or
+    // 1, and 1 for properties that use Perf, Baseline or Cover.
+    Property<Args...> & Shards(unsigned int n)
+    {
+        shards = std::max(1u, n);
+        return *this;
+    }
+
+    // Mixes edge cases into the values of the integral and floating point
+    // generators of the property (see Arbitrary) at the given rate, from 0
+    // (none) to 1: the bounds of their ranges, 0, 1, -1, the powers of two
+    // and the values next to them, and for floating point types -0.0, the
+    // denormals, epsilon and the extremes. How often each kind came up is
+    // printed with the result. Generators that set their own rate keep it.
+    // The default is the environment variable QCPPC_EDGE_RATE, or 0, so
+    // that the inputs stay uniform unless asked.
+    Property<Args...> & Edges(double rate)
+    {
+        edge_rate = rate;
+        return *this;
+    }
+
+    // Sets the number of tests of an asynchronous property that may be
+    // in flight at once.
+    Property<Args...> & Concurrency(unsigned int n)
+    {
+        concurrency = std::max(1u, n);
+        return *this;
+    }
+
+    // Collects a number from every input, such as the length of a vector,
+    // under the given name. Its count, mean, standard deviation, extremes
+    // and quantiles are printed with the result; they are kept in constant
+    // memory however many tests run (see stats.hpp). Numbers known only in
+    // the property function, like elapsed times, can be collected there
+    // with qcppc::collect.
+    Property<Args...> & Collect(const std::string & name, const CollectorType & collector)
+    {
+        collectors.push_back(std::make_pair(name, collector));
+        collect_input = hook(&Property::collect_data);
+        return *this;
+    }
+
+    // Requires at least percent % of the inputs to be in the class label
+    // (see Classify), or the property fails with "*** Insufficient
+    // coverage". The coverage is checked every 100 tests with Wilson
+    // bounds: the run stops early, as passed, once every requirement is
+    // surely met (within 10% of it), and fails early once one surely
+    // can't be. Otherwise the coverage observed after all the tests
+    // decides. Sharded and asynchronous properties don't stop early.
+    Property<Args...> & Cover(const std::string & label, double percent)
+    {
+        extensions.get_or_make<detail::CoverExtension>(detail::COVER_EXTENSION)
+            .requirements.push_back(detail::CoverRequirement{label, percent});
         return *this;
     }
 
@@ -227,6 +1403,7 @@ public:
     Property<Args...> & Classify(const ClassifierType & classifier_fun)
     {
         classifier = Classifier<typename std::decay<Args>::type...>(classifier_fun);
+        classify_input = classifier_fun ? hook(&Property::classify_data) : nullptr;
         return *this;
     }
 
@@ -235,12 +1412,17 @@ public:
 // Helper function to create objects of Property class.
 // Extracts the types of the arguments of the property function
 // and uses them to instantiate template class Property.
+//
+// Functions that return std::future<bool> instead of bool make
+// asynchronous properties.
 template<typename T, typename...Params,
     typename Property = typename Unpack<
             typename function_traits<T>::arg_types, Property
         >::type>
 typename std::enable_if<std::is_same<
         typename function_traits<T>::return_type, bool
+      >::value || std::is_same<
+        typename function_traits<T>::return_type, std::future<bool>
       >::value, Property
     >::type
 property(const T & t, Params...params)
@@ -0,0 +1,15 @@
+// The compiled part of qcppc: instantiations of the common generators,
+// shared by all the translation units built with QCPPC_USE_LIBRARY.
+
+#include "generator.hpp"
+
+namespace qcppc {
+
+#define QCPPC_INSTANTIATE_GENERATOR(T) \
+    template struct Arbitrary<T>; \
+    template struct Generator<T>;
+QCPPC_COMMON_TYPES(QCPPC_INSTANTIATE_GENERATOR)
+template struct Generator<bool>;
+#undef QCPPC_INSTANTIATE_GENERATOR
+
+} // namespace qcppc
@@ -0,0 +1,173 @@
+// Field reflection of aggregates for qcppc.
+//
+// Finds the fields of an aggregate, such as a plain struct, without any
+// help from the type, in the style of Boost.PFR: the fields are counted by
+// trying to initialize it with more and more of them, and reached with
+// structured bindings. Only aggregates of up to MAX_FIELDS fields, without
+// base classes or bit-fields, are supported.
+
+#ifndef QCPPC_REFLECT_H_
+#define QCPPC_REFLECT_H_
+
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <cstddef>
+
+namespace qcppc {
+namespace detail {
+
+static const size_t MAX_FIELDS = 16;
+
+// Stands for the initializer of a field of any type.
+struct AnyField
+{
+    template<typename U>
+    operator U() const;
+};
+
+// Whether T can be initialized with the given number of braced
+// initializers, as in T{{a}, {b}}. Each braced one initializes a whole
+// field, even an array or an aggregate, so T can be initialized with as
+// many of them as it has fields but no more.
+template<typename T, typename Indices, typename Enable = void>
+struct initializable_with : std::false_type {};
+
+template<typename T, size_t... I>
+struct initializable_with<T, std::index_sequence<I...>,
+        std::void_t<decltype(T{{(void(I), AnyField())}...})>> : std::true_type {};
+
+template<typename T, size_t N>
+struct initializable_with_n : initializable_with<T, std::make_index_sequence<N>> {};
+
+template<typename T, size_t N = 0>
+constexpr size_t count_fields()
+{
+    if constexpr (N <= MAX_FIELDS && initializable_with_n<T, N + 1>::value) {
+        return count_fields<T, N + 1>();
+    } else {
+        return N;
+    }
+}
+
+// References to the N fields of t, in order.
+template<size_t N, typename T>
+auto tie_fields(T & t)
+{
+    static_assert(N >= 1 && N <= MAX_FIELDS, "unsupported number of fields");
+    if constexpr (N == 1) {
+        auto & [a] = t;
+        return std::tie(a);
+    } else if constexpr (N == 2) {
+        auto & [a, b] = t;
+        return std::tie(a, b);
+    } else if constexpr (N == 3) {
+        auto & [a, b, c] = t;
+        return std::tie(a, b, c);
+    } else if constexpr (N == 4) {
+        auto & [a, b, c, d] = t;
+        return std::tie(a, b, c, d);
+    } else if constexpr (N == 5) {
+        auto & [a, b, c, d, e] = t;
+        return std::tie(a, b, c, d, e);
+    } else if constexpr (N == 6) {
+        auto & [a, b, c, d, e, f] = t;
+        return std::tie(a, b, c, d, e, f);
+    } else if constexpr (N == 7) {
+        auto & [a, b, c, d, e, f, g] = t;
+        return std::tie(a, b, c, d, e, f, g);
+    } else if constexpr (N == 8) {
+        auto & [a, b, c, d, e, f, g, h] = t;
+        return std::tie(a, b, c, d, e, f, g, h);
+    } else if constexpr (N == 9) {
+        auto & [a, b, c, d, e, f, g, h, i] = t;
+        return std::tie(a, b, c, d, e, f, g, h, i);
+    } else if constexpr (N == 10) {
+        auto & [a, b, c, d, e, f, g, h, i, j] = t;
+        return std::tie(a, b, c, d, e, f, g, h, i, j);
+    } else if constexpr (N == 11) {
+        auto & [a, b, c, d, e, f, g, h, i, j, k] = t;
+        return std::tie(a, b, c, d, e, f, g, h, i, j, k);
+    } else if constexpr (N == 12) {
+        auto & [a, b, c, d, e, f, g, h, i, j, k, l] = t;
+        return std::tie(a, b, c, d, e, f, g, h, i, j, k, l);
+    } else if constexpr (N == 13) {
+        auto & [a, b, c, d, e, f, g, h, i, j, k, l, m] = t;
+        return std::tie(a, b, c, d, e, f, g, h, i, j, k, l, m);
+    } else if constexpr (N == 14) {
+        auto & [a, b, c, d, e, f, g, h, i, j, k, l, m, n] = t;
+        return std::tie(a, b, c, d, e, f, g, h, i, j, k, l, m, n);
+    } else if constexpr (N == 15) {
+        auto & [a, b, c, d, e, f, g, h, i, j, k, l, m, n, o] = t;
+        return std::tie(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o);
+    } else {
+        auto & [a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p] = t;
+        return std::tie(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p);
+    }
+}
+
+// Whether T is a tuple-like type, such as std::array, whose structured
+// bindings are its elements rather than its fields.
+template<typename T, typename Enable = void>
+struct is_tuple_like : std::false_type {};
+
+template<typename T>
+struct is_tuple_like<T, std::void_t<decltype(std::tuple_size<T>::value)>> : std::true_type {};
+
+// Whether the fields of T can be found: T is an aggregate class, neither
+// a union nor tuple-like, of 1 to MAX_FIELDS fields.
+template<typename T, typename Enable = void>
+struct is_reflectable_class : std::false_type {};
+
+template<typename T>
+struct is_reflectable_class<T, typename std::enable_if<
+        std::is_aggregate<T>::value && std::is_class<T>::value &&
+        !is_tuple_like<T>::value>::type>
+{
+    enum { value = count_fields<T>() >= 1 && count_fields<T>() <= MAX_FIELDS };
+};
+
+// The types of the fields of T, as an std::tuple.
+template<typename T>
+struct fields_of
+{
+    typedef decltype(tie_fields<count_fields<T>()>(std::declval<T&>())) refs_type;
+
+    template<typename Refs>
+    struct Decay;
+
+    template<typename... Refs>
+    struct Decay<std::tuple<Refs...>>
+    {
+        typedef std::tuple<typename std::remove_reference<Refs>::type...> type;
+    };
+
+    typedef typename Decay<refs_type>::type type;
+    enum { size = std::tuple_size<type>::value };
+};
+
+// Whether T is an aggregate whose fields can be found and set one by one
+// in a default constructed T: none of them is a reference or const.
+template<typename T, bool = is_reflectable_class<T>::value>
+struct is_reflectable : std::false_type {};
+
+template<typename T>
+struct is_reflectable<T, true>
+{
+    template<typename Fields>
+    struct Settable;
+
+    template<typename... Fields>
+    struct Settable<std::tuple<Fields...>>
+    {
+        enum { value = (... && !std::is_const<Fields>::value) };
+    };
+
+    enum { value = std::is_default_constructible<T>::value &&
+        Settable<typename fields_of<T>::type>::value };
+};
+
+} // namespace detail
+} // namespace qcppc
+
+#endif // QCPPC_REFLECT_H_
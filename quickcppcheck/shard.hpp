@@ -0,0 +1,287 @@
+// Multi-process sharding for qcppc.
+//
+// With Property::Shards(n), the tests of a property are split in n
+// contiguous slices of their indices, each run by a child process, and
+// the results of the workers are merged as if a single process had run
+// them all. Every worker also draws (but doesn't run) the inputs of the
+// tests before its slice, so that its generators take exactly the values
+// a single process would; what it reports is only about its own slice.
+//
+// It helps when the code under test keeps global state or isn't
+// thread-safe, and it isolates crashes: a worker that dies fails the
+// property.
+
+#ifndef QCPPC_SHARD_H_
+#define QCPPC_SHARD_H_
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define QCPPC_HAS_FORK 1
+#endif
+
+namespace qcppc {
+namespace detail {
+
+// What a worker found running its slice of the tests.
+struct ShardResult
+{
+    // The first and last test of the slice.
+    unsigned int first;
+    unsigned int last;
+
+    // Whether the worker delivered its result, and if not why.
+    bool delivered;
+    std::string error;
+
+    unsigned int tests;
+    unsigned int discarded;
+    unsigned int duplicates;
+
+    // The first failing test, 0 if none, its input (in full, if saved) and
+    // why it failed (empty if the property returned false).
+    unsigned int failed;
+    std::string input;
+    std::string full;
+    std::string reason;
+
+    // The test at which the arguments got exhausted, 0 if they didn't.
+    unsigned int exhausted_at;
+
+    // What the worker printed, e.g. the inputs with verbose > 1.
+    std::string text;
+
+    std::map<std::string, size_t> classes;
+
+    // The values drawn by the generators that mix in edge cases, and the
+    // edge cases of each kind.
+    size_t edge_values;
+    std::map<std::string, size_t> edges;
+
+    // The statistics collected (see stats.hpp), encoded.
+    std::string stats;
+
+    ShardResult():first(0), last(0), delivered(false), tests(0), discarded(0),
+        duplicates(0), failed(0), exhausted_at(0), edge_values(0)
+    {}
+};
+
+inline void put_string(std::ostream & out, const std::string & s)
+{
+    out<<s.size()<<":"<<s;
+}
+
+inline bool get_string(std::istream & in, std::string & s)
+{
+    size_t n;
+    char colon;
+    if (!(in>>n) || !in.get(colon) || colon != ':') {
+        return false;
+    }
+    s.resize(n);
+    return n == 0 || in.read(&s[0], n);
+}
+
+inline void put_counts(std::ostream & out, const std::map<std::string, size_t> & counts)
+{
+    out<<counts.size()<<" ";
+    for (auto &it:counts) {
+        put_string(out, it.first);
+        out<<" "<<it.second<<" ";
+    }
+}
+
+inline bool get_counts(std::istream & in, std::map<std::string, size_t> & counts)
+{
+    size_t n;
+    if (!(in>>n)) {
+        return false;
+    }
+    for (size_t k = 0;k < n;++k) {
+        std::string label;
+        size_t count;
+        in.get();
+        if (!get_string(in, label) || !(in>>count)) {
+            return false;
+        }
+        counts[label] = count;
+    }
+    in.get();
+    return true;
+}
+
+inline std::string encode_shard_result(const ShardResult & r)
+{
+    std::ostringstream out;
+    out<<r.tests<<" "<<r.discarded<<" "<<r.duplicates<<" "<<r.failed<<" "
+        <<r.exhausted_at<<" "<<r.edge_values<<" ";
+    put_counts(out, r.classes);
+    put_counts(out, r.edges);
+    put_string(out, r.input);
+    put_string(out, r.full);
+    put_string(out, r.reason);
+    put_string(out, r.text);
+    put_string(out, r.stats);
+    return out.str();
+}
+
+// Decodes the result of a worker into r. Returns false if it is truncated.
+inline bool decode_shard_result(const std::string & s, ShardResult & r)
+{
+    std::istringstream in(s);
+    if (!(in>>r.tests>>r.discarded>>r.duplicates>>r.failed>>r.exhausted_at>>r.edge_values) ||
+            !get_counts(in, r.classes) || !get_counts(in, r.edges)) {
+        return false;
+    }
+    return get_string(in, r.input) && get_string(in, r.full) && get_string(in, r.reason) &&
+        get_string(in, r.text) && get_string(in, r.stats);
+}
+
+// Whether this thread must not fork, because other threads run tests at
+// the same time, e.g. it is a worker of run_suite: the child would only
+// have this thread, and might find locks held by the others forever.
+inline bool & forking_disabled()
+{
+    static thread_local bool disabled = false;
+    return disabled;
+}
+
+// Runs work(first, last) for n contiguous slices of the tests 1..ntests,
+// each in a child process, and returns their results in order. Where
+// processes can't be forked, or forking is disabled, a single slice runs
+// in this process.
+inline std::vector<ShardResult> run_shards(unsigned int n, unsigned int ntests,
+        const std::function<ShardResult(unsigned int, unsigned int)> & work)
+{
+    std::vector<ShardResult> results;
+#ifdef QCPPC_HAS_FORK
+    bool can_fork = !forking_disabled();
+#else
+    bool can_fork = false;
+#endif
+    if (!can_fork) {
+        ShardResult r = work(1, ntests);
+        r.first = 1;
+        r.last = ntests;
+        r.delivered = true;
+        results.push_back(r);
+        return results;
+    }
+
+#ifdef QCPPC_HAS_FORK
+    n = std::max(1u, std::min(n, ntests));
+    std::vector<int> fds;
+    std::vector<pid_t> pids;
+    std::cout.flush();
+    std::cerr.flush();
+    for (unsigned int k = 0;k < n;++k) {
+        ShardResult r;
+        r.first = unsigned(uint64_t(ntests) * k / n) + 1;
+        r.last = unsigned(uint64_t(ntests) * (k + 1) / n);
+        results.push_back(r);
+
+        int fd[2];
+        pid_t pid = -1;
+        if (pipe(fd) == 0) {
+            pid = fork();
+            if (pid == 0) {
+                // The child never returns into the caller, which would go
+                // on running the program, even if work throws.
+                close(fd[0]);
+                std::string msg;
+                try {
+                    msg = encode_shard_result(work(r.first, r.last));
+                } catch (...) {
+                    ShardResult thrown;
+                    thrown.failed = r.first;
+                    thrown.input = "(unknown input)\n";
+                    thrown.reason = "the worker threw an exception.";
+                    msg = encode_shard_result(thrown);
+                }
+                const char * p = msg.data();
+                size_t left = msg.size();
+                while (left > 0) {
+                    ssize_t written = write(fd[1], p, left);
+                    if (written <= 0) break;
+                    p += written;
+                    left -= written;
+                }
+                _exit(0);
+            }
+            close(fd[1]);
+            if (pid < 0) {
+                close(fd[0]);
+            }
+        }
+        if (pid < 0) {
+            results.back().error = std::string("could not start a worker: ") +
+                std::strerror(errno);
+            fds.push_back(-1);
+        } else {
+            fds.push_back(fd[0]);
+        }
+        pids.push_back(pid);
+    }
+
+    for (unsigned int k = 0;k < n;++k) {
+        if (fds[k] == -1) {
+            continue;
+        }
+        std::string msg;
+        char buf[4096];
+        ssize_t got;
+        while ((got = read(fds[k], buf, sizeof(buf))) > 0) {
+            msg.append(buf, got);
+        }
+        close(fds[k]);
+
+        int status = 0;
+        waitpid(pids[k], &status, 0);
+        ShardResult & r = results[k];
+        r.delivered = WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+            decode_shard_result(msg, r);
+        if (!r.delivered) {
+            std::ostringstream error;
+            error<<"the worker of tests "<<r.first<<" to "<<r.last;
+            if (WIFSIGNALED(status)) {
+                error<<" was killed by signal "<<WTERMSIG(status)<<" ("
+                    <<strsignal(WTERMSIG(status))<<")";
+            } else {
+                error<<" died";
+            }
+            r.error = error.str();
+        }
+    }
+#else
+    (void)n;
+#endif
+    return results;
+}
+
+// The number of processes to run every property in, when it doesn't set
+// one itself (environment variable QCPPC_SHARDS), 1 by default. It doesn't
+// apply to properties that use Perf, Baseline or Cover, see Property::Shards.
+inline unsigned int default_shards()
+{
+    const char * env = std::getenv("QCPPC_SHARDS");
+    int n = env ? std::atoi(env) : 1;
+    return n > 1 ? n : 1;
+}
+
+} // namespace detail
+} // namespace qcppc
+
+#endif // QCPPC_SHARD_H_
@@ -0,0 +1,562 @@
+// Stateful (model based) testing for qcppc.
+//
+// A state machine property generates sequences of commands and applies
+// each sequence to a fresh system under test and to a fresh model of it.
+// Every command runs on both and their results are compared; a failing
+// sequence is shrunk to a minimal one before it is reported.
+//
+// With Threads(n) the sequences run concurrently from n threads on a
+// shared system instead, and the recorded history is checked for
+// linearizability against the model.
+
+#ifndef QCPPC_STATEFUL_H_
+#define QCPPC_STATEFUL_H_
+
+#include <iostream>
+#include <functional>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+#include "property.hpp"
+#include "linearizability.hpp"
+
+namespace qcppc {
+
+namespace detail {
+
+// Interface of a command of a state machine over Sut and Model.
+// The arguments of the generated steps are kept by the command itself,
+// a step only refers to them through a slot index.
+template<typename Sut, typename Model>
+struct CommandBase
+{
+    std::string name;
+    double weight;
+
+    CommandBase(const std::string & name):name(name), weight(1) {}
+    virtual ~CommandBase() {}
+
+    // Generates a new argument and returns its slot.
+    virtual size_t generate() = 0;
+
+    // Forgets all the generated arguments.
+    virtual void clear() = 0;
+
+    // Checks the precondition of the step in slot against model.
+    virtual bool pre(const Model & model, size_t slot) = 0;
+
+    // Whether the command has a precondition.
+    virtual bool has_pre() const = 0;
+
+    // Runs the step in slot on both sut and model and compares the results.
+    virtual bool run(Sut & sut, Model & model, size_t slot) = 0;
+
+    // Runs the step in slot on sut only and records its result.
+    // Steps in different slots may run concurrently.
+    virtual void run_sut(Sut & sut, size_t slot) = 0;
+
+    // Runs the step in slot on model and compares with the recorded result.
+    virtual bool check(Model & model, size_t slot) = 0;
+
+    virtual void print(std::ostream & out, size_t slot) = 0;
+
+    virtual void print_result(std::ostream & out, size_t slot) = 0;
+};
+
+// The argument of the commands that take none, printed as nothing.
+struct NoArg {};
+
+inline std::ostream & operator<<(std::ostream & out, const NoArg &)
+{
+    return out;
+}
+
+// The number of arguments of F.
+template<typename F>
+struct arity
+{
+    enum { value = std::tuple_size<typename function_traits<F>::arg_types>::value };
+};
+
+// The part of a command that depends only on its argument type.
+template<typename Sut, typename Model, typename Arg>
+struct ArgCommand : CommandBase<Sut, Model>
+{
+    typedef std::function<bool(const Model&, const Arg&)> PreType;
+
+    Generator<Arg> gen;
+    PreType pre_fun;
+    std::vector<Arg> args;
+
+    ArgCommand(const std::string & name, const Generator<Arg> & gen):
+        CommandBase<Sut, Model>(name), gen(gen), pre_fun(nullptr)
+    {}
+
+    size_t generate() {
+        args.push_back(gen());
+        return args.size() - 1;
+    }
+
+    void clear() {
+        args.clear();
+    }
+
+    bool pre(const Model & model, size_t slot) {
+        return !pre_fun || pre_fun(model, args[slot]);
+    }
+
+    bool has_pre() const {
+        return pre_fun != nullptr;
+    }
+
+    void print(std::ostream & out, size_t slot) {
+        out<<this->name<<"(";
+        print_helper(out, args[slot]);
+        out<<")";
+    }
+};
+
+template<typename Sut, typename Model, typename Arg, typename R>
+struct Command : ArgCommand<Sut, Model, Arg>
+{
+    typedef std::function<R(Sut&, const Arg&)> SutFunType;
+    typedef std::function<R(Model&, const Arg&)> ModelFunType;
+
+    // Wrapped, so that results in different slots are different objects
+    // even when R is bool.
+    struct Result {
+        R value;
+    };
+
+    SutFunType sut_fun;
+    ModelFunType model_fun;
+    std::vector<Result> results;
+
+    Command(const std::string & name, const Generator<Arg> & gen,
+            const SutFunType & sut_fun, const ModelFunType & model_fun):
+        ArgCommand<Sut, Model, Arg>(name, gen), sut_fun(sut_fun),
+        model_fun(model_fun)
+    {}
+
+    size_t generate() {
+        results.emplace_back();
+        return ArgCommand<Sut, Model, Arg>::generate();
+    }
+
+    void clear() {
+        results.clear();
+        ArgCommand<Sut, Model, Arg>::clear();
+    }
+
+    bool run(Sut & sut, Model & model, size_t slot) {
+        return sut_fun(sut, this->args[slot]) == model_fun(model, this->args[slot]);
+    }
+
+    void run_sut(Sut & sut, size_t slot) {
+        results[slot].value = sut_fun(sut, this->args[slot]);
+    }
+
+    bool check(Model & model, size_t slot) {
+        return results[slot].value == model_fun(model, this->args[slot]);
+    }
+
+    void print_result(std::ostream & out, size_t slot) {
+        out<<" -> ";
+        print_helper(out, results[slot].value);
+    }
+};
+
+// Commands without a result only have to run on both sides.
+template<typename Sut, typename Model, typename Arg>
+struct Command<Sut, Model, Arg, void> : ArgCommand<Sut, Model, Arg>
+{
+    typedef std::function<void(Sut&, const Arg&)> SutFunType;
+    typedef std::function<void(Model&, const Arg&)> ModelFunType;
+
+    SutFunType sut_fun;
+    ModelFunType model_fun;
+
+    Command(const std::string & name, const Generator<Arg> & gen,
+            const SutFunType & sut_fun, const ModelFunType & model_fun):
+        ArgCommand<Sut, Model, Arg>(name, gen), sut_fun(sut_fun),
+        model_fun(model_fun)
+    {}
+
+    bool run(Sut & sut, Model & model, size_t slot) {
+        sut_fun(sut, this->args[slot]);
+        model_fun(model, this->args[slot]);
+        return true;
+    }
+
+    void run_sut(Sut & sut, size_t slot) {
+        sut_fun(sut, this->args[slot]);
+    }
+
+    bool check(Model & model, size_t slot) {
+        model_fun(model, this->args[slot]);
+        return true;
+    }
+
+    void print_result(std::ostream &, size_t) {}
+};
+
+} // namespace detail
+
+// An object of class StateMachine contains the commands of a stateful
+// property over a system under test of type Sut and a model of type Model.
+// Both have to be default constructible; every test starts from fresh ones.
+template<typename Sut, typename Model>
+class StateMachine : ArbitraryBase
+{
+private:
+    typedef detail::CommandBase<Sut, Model> CommandType;
+    typedef std::function<bool(const Sut&, const Model&)> InvariantType;
+
+    // A step of a generated sequence: a command and the slot of its argument.
+    struct Step {
+        size_t cmd;
+        size_t slot;
+    };
+
+    std::vector<std::unique_ptr<CommandType>> commands;
+
+    // Checked after every step, if set.
+    InvariantType invariant;
+
+    // Number of threads the sequences run from; 0 runs them sequentially.
+    unsigned int threads;
+
+    // Description of the property.
+    std::string name;
+
+    // Output verbosity level.
+    int verbose;
+
+    // Max number of tests to run, if user does not specify.
+    static constexpr unsigned int MAX_TESTS = 100;
+
+    // Max length of a generated sequence, if user does not specify.
+    static constexpr unsigned int MAX_STEPS = 100;
+
+    // Runs steps on a fresh system and model. Returns the position of the
+    // failing step or steps.size() if all of them pass. Steps whose
+    // precondition does not hold are skipped, so that any subsequence of a
+    // valid sequence is valid as well.
+    size_t run(const std::vector<Step> & steps)
+    {
+        Sut sut;
+        Model model;
+        for (size_t i = 0;i < steps.size();++i) {
+            CommandType & cmd = *commands[steps[i].cmd];
+            if (!cmd.pre(model, steps[i].slot)) {
+                continue;
+            }
+            if (!cmd.run(sut, model, steps[i].slot) ||
+                    (invariant && !invariant(sut, model))) {
+                return i;
+            }
+        }
+        return steps.size();
+    }
+
+    // Shrinks a failing sequence by removing chunks of steps as long as
+    // the rest still fails, halving the chunk size down to single steps.
+    size_t shrink(std::vector<Step> & steps, size_t failed)
+    {
+        size_t shrinks = 0;
+        steps.resize(failed + 1);
+        for (size_t chunk = steps.size() / 2;chunk > 0;chunk /= 2) {
+            for (size_t i = 0;i < steps.size();) {
+                std::vector<Step> candidate(steps.begin(), steps.begin() + i);
+                candidate.insert(candidate.end(),
+                        steps.begin() + std::min(i + chunk, steps.size()), steps.end());
+                failed = run(candidate);
+                if (failed < candidate.size()) {
+                    candidate.resize(failed + 1);
+                    steps.swap(candidate);
+                    ++shrinks;
+                } else {
+                    i += chunk;
+                }
+            }
+        }
+        return shrinks;
+    }
+
+    // Runs the steps of every thread concurrently on a fresh system and
+    // checks the recorded history for linearizability against a fresh
+    // model. The invariant, if set, is checked once all threads are done,
+    // against the model of the found linearization.
+    bool run_concurrent(const std::vector<std::vector<Step>> & steps,
+            std::vector<detail::Operation> & history)
+    {
+        Sut sut;
+        std::vector<std::vector<detail::Operation>> ops(steps.size());
+        std::atomic<size_t> ready(0);
+        std::vector<std::thread> workers;
+
+        for (size_t t = 0;t < steps.size();++t) {
+            workers.push_back(std::thread([this, t, &sut, &steps, &ops, &ready]() {
+                // Start all threads at once to get as much overlap as possible.
+                ++ready;
+                while (ready.load() < steps.size()) {
+                    std::this_thread::yield();
+                }
+                ops[t].reserve(steps[t].size());
+                for (auto &step:steps[t]) {
+                    detail::Operation op{t, step.cmd, step.slot, 0, 0};
+                    op.call = detail::timestamp();
+                    commands[step.cmd]->run_sut(sut, step.slot);
+                    op.ret = detail::timestamp();
+                    ops[t].push_back(op);
+                }
+            }));
+        }
+        for (auto &w:workers) w.join();
+
+        history.clear();
+        for (auto &o:ops) history.insert(history.end(), o.begin(), o.end());
+
+        Model model;
+        bool ok = detail::check_linearizable(history, model,
+                [this](Model & m, const detail::Operation & op) {
+                    return commands[op.cmd]->check(m, op.slot);
+                });
+        return ok && (!invariant || invariant(sut, model));
+    }
+
+    void print_history(const std::vector<detail::Operation> & history)
+    {
+        std::ostream & out = detail::output();
+        std::vector<detail::Operation> sorted(history);
+        std::sort(sorted.begin(), sorted.end(),
+                [](const detail::Operation & a, const detail::Operation & b)
+                    { return a.call < b.call; });
+        uint64_t start = sorted.empty() ? 0 : sorted[0].call;
+        for (auto &op:sorted) {
+            out<<"  thread "<<op.thread<<": ";
+            commands[op.cmd]->print(out, op.slot);
+            commands[op.cmd]->print_result(out, op.slot);
+            out<<" ["<<op.call - start<<", "<<op.ret - start<<"]"<<std::endl;
+        }
+    }
+
+    void print_steps(const std::vector<Step> & steps)
+    {
+        std::ostream & out = detail::output();
+        for (size_t i = 0;i < steps.size();++i) {
+            out<<"  ";
+            commands[steps[i].cmd]->print(out, steps[i].slot);
+            out<<std::endl;
+        }
+    }
+
+    template<typename SutFun, typename ModelFun, typename Gen>
+    StateMachine<Sut, Model> & add(const std::string & name, const Gen & gen,
+            const SutFun & sut_fun, const ModelFun & model_fun)
+    {
+        typedef typename std::decay<typename std::tuple_element<1,
+                typename function_traits<SutFun>::arg_types>::type>::type Arg;
+        typedef typename function_traits<SutFun>::return_type R;
+        commands.push_back(std::unique_ptr<CommandType>(
+                    new detail::Command<Sut, Model, Arg, R>(
+                        name, Generator<Arg>(gen), sut_fun, model_fun)));
+        return *this;
+    }
+
+public:
+    // Constructs an empty StateMachine.
+    //
+    // name, verbose: as for class Property. With verbose=2 the length of
+    //  every generated sequence is printed as well.
+    StateMachine(const std::string & name = std::string("<unnamed>"), int verbose = 1):
+        invariant(nullptr), threads(0), name(name), verbose(verbose)
+    {}
+
+    // Runs ntests sequences of up to max_steps commands each, or until
+    // a sequence fails. Each sequence is generated completely before it
+    // runs, so the steps of a test run back to back. With Threads(n),
+    // every test runs n such sequences concurrently.
+    bool operator()(unsigned int ntests = MAX_TESTS,
+            unsigned int max_steps = MAX_STEPS)
+    {
+        std::ostream & out = detail::output();
+        assert(!commands.empty());
+
+        std::vector<double> weights;
+        for (auto &cmd:commands) weights.push_back(cmd->weight);
+        std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+        std::uniform_int_distribution<size_t> length(0, max_steps);
+        std::vector<size_t> counts(commands.size(), 0);
+
+        if (verbose > 0) {
+            out<<"Property: "<<MAKE_YELLOW(name)<<std::endl;
+        }
+
+        // The system runs without a model under Threads, so a step can't be
+        // skipped when its precondition does not hold.
+        for (auto &cmd:commands) {
+            if (threads && cmd->has_pre()) {
+                if (verbose > 0) {
+                    out<<MAKE_RED("*** Unsupported,")<<" command "<<cmd->name
+                        <<" has a precondition, which Threads can't check."<<std::endl
+                        <<std::endl;
+                }
+                return false;
+            }
+        }
+
+        bool ok = true;
+        size_t total = 0;
+        for (unsigned int i = 1; i <= ntests; ++i) {
+            for (auto &cmd:commands) cmd->clear();
+
+            // One sequence per thread, or a single one without threads.
+            std::vector<std::vector<Step>> seqs(std::max(threads, 1u));
+            for (auto &steps:seqs) {
+                size_t n = length(engine);
+                for (size_t s = 0;s < n;++s) {
+                    size_t c = pick(engine);
+                    steps.push_back(Step{c, commands[c]->generate()});
+                    ++counts[c];
+                }
+                total += n;
+                if (verbose > 1) {
+                    out<<i<<": "<<n<<" steps"<<std::endl;
+                }
+            }
+
+            if (threads) {
+                std::vector<detail::Operation> history;
+                if (!run_concurrent(seqs, history)) {
+                    if (verbose > 0) {
+                        out<<MAKE_RED("*** Not linearizable,")<<" after "<<i
+                            <<" tests:"<<std::endl;
+                        print_history(history);
+                    }
+                    ok = false;
+                    break;
+                }
+                continue;
+            }
+
+            std::vector<Step> & steps = seqs[0];
+            size_t failed = run(steps);
+            if (failed < steps.size()) {
+                size_t shrinks = shrink(steps, failed);
+                if (verbose > 0) {
+                    out<<MAKE_RED("*** Falsifiable,")<<" after "<<i<<" tests"
+                        <<" and "<<shrinks<<" shrinks:"<<std::endl;
+                    print_steps(steps);
+                }
+                ok = false;
+                break;
+            }
+        }
+
+        if (verbose > 0) {
+            if (ok) {
+                out<<MAKE_GREEN("+++ OK,")<<" passed "<<ntests<<" tests."<<std::endl;
+            }
+            for (size_t c = 0;c < commands.size() && total;++c) {
+                out<<std::setw(4)<<size_t(ceil(100 * float(counts[c]) / total))
+                    <<"% "<<commands[c]->name<<"."<<std::endl;
+            }
+            out<<std::endl;
+        }
+        return ok;
+    }
+
+    // Adds a command. sut_fun and model_fun have types R(Sut&, const Arg&)
+    // and R(Model&, const Arg&) respectively; their results are compared
+    // with operator== unless R is void. gen is the generator for Arg.
+    template<typename SutFun, typename ModelFun, typename Gen>
+    StateMachine<Sut, Model> & Command(const std::string & name, const Gen & gen,
+            const SutFun & sut_fun, const ModelFun & model_fun)
+    {
+        return add(name, gen, sut_fun, model_fun);
+    }
+
+    // Same as above, only use Arbitrary<Arg> as the generator. Commands
+    // without an argument, such as pop or size, have sut_fun and model_fun
+    // of types R(Sut&) and R(Model&) instead.
+    template<typename SutFun, typename ModelFun>
+    StateMachine<Sut, Model> & Command(const std::string & name,
+            const SutFun & sut_fun, const ModelFun & model_fun)
+    {
+        if constexpr (detail::arity<SutFun>::value == 1) {
+            typedef typename function_traits<SutFun>::return_type R;
+            return add(name, []() { return detail::NoArg(); },
+                    [sut_fun](Sut & sut, const detail::NoArg &) -> R { return sut_fun(sut); },
+                    [model_fun](Model & model, const detail::NoArg &) -> R
+                        { return model_fun(model); });
+        } else {
+            typedef typename std::decay<typename std::tuple_element<1,
+                    typename function_traits<SutFun>::arg_types>::type>::type Arg;
+            return add(name, Arbitrary<Arg>(), sut_fun, model_fun);
+        }
+    }
+
+    // Sets the precondition of the last added command. It should have type
+    // bool(const Model&, const Arg&), where Arg is the argument type of
+    // the command, or bool(const Model&) for a command without one.
+    template<typename PreFun>
+    StateMachine<Sut, Model> & Pre(const PreFun & pre)
+    {
+        if constexpr (detail::arity<PreFun>::value == 1) {
+            return Pre([pre](const Model & model, const detail::NoArg &) -> bool
+                    { return pre(model); });
+        } else {
+            typedef typename std::decay<typename std::tuple_element<1,
+                    typename function_traits<PreFun>::arg_types>::type>::type Arg;
+            assert(!commands.empty());
+            auto cmd = dynamic_cast<detail::ArgCommand<Sut, Model, Arg>*>(
+                    commands.back().get());
+            assert(cmd && "Pre: argument type does not match the last command");
+            cmd->pre_fun = pre;
+            return *this;
+        }
+    }
+
+    // Sets the relative frequency of the last added command (default 1).
+    StateMachine<Sut, Model> & Weight(double weight)
+    {
+        assert(!commands.empty() && weight >= 0);
+        commands.back()->weight = weight;
+        return *this;
+    }
+
+    // Runs the sequences concurrently from n threads on a shared system and
+    // checks that the results are linearizable with respect to the model.
+    // Commands can't have preconditions (see Pre) then: the system runs
+    // without a model, so it can't skip steps as the sequential runs do,
+    // and the property fails as unsupported. Searching for a linearization
+    // is much faster when Model has operator<, which lets the checker skip
+    // states it already visited.
+    StateMachine<Sut, Model> & Threads(unsigned int threads)
+    {
+        this->threads = threads;
+        return *this;
+    }
+
+    // Sets a check on the system and the model that runs after every step.
+    StateMachine<Sut, Model> & Invariant(const InvariantType & invariant)
+    {
+        this->invariant = invariant;
+        return *this;
+    }
+};
+
+// Helper function to create objects of StateMachine class.
+template<typename Sut, typename Model, typename...Params>
+StateMachine<Sut, Model> stateful(Params...params)
+{
+    return StateMachine<Sut, Model>(std::forward<Params>(params)...);
+}
+
+} // namespace qcppc
+
+#endif // QCPPC_STATEFUL_H_
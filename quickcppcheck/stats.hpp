@@ -0,0 +1,340 @@
+// Streaming statistics for qcppc.
+//
+// Numbers collected from the tests of a property (see Property::Collect
+// and qcppc::collect) are summarized in constant memory: count, mean,
+// variance, min and max, and their quantiles with a KLL sketch, which
+// keeps a few hundred samples whatever the number of values. Summaries
+// can be merged, e.g. those of the workers of a sharded property.
+
+#ifndef QCPPC_STATS_H_
+#define QCPPC_STATS_H_
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+
+#include "alloc.hpp"
+
+namespace qcppc {
+namespace detail {
+
+// Mean and variance with Welford's method, and the extremes.
+struct RunningStats
+{
+    uint64_t count;
+    double mean;
+    double m2;
+    double min;
+    double max;
+
+    RunningStats():count(0), mean(0), m2(0),
+        min(std::numeric_limits<double>::infinity()),
+        max(-std::numeric_limits<double>::infinity())
+    {}
+
+    void add(double x) {
+        ++count;
+        double delta = x - mean;
+        mean += delta / count;
+        m2 += delta * (x - mean);
+        min = std::min(min, x);
+        max = std::max(max, x);
+    }
+
+    void merge(const RunningStats & other) {
+        if (other.count == 0) {
+            return;
+        }
+        uint64_t n = count + other.count;
+        double delta = other.mean - mean;
+        mean += delta * other.count / n;
+        m2 += other.m2 + delta * delta * (double(count) * other.count / n);
+        count = n;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+
+    double variance() const {
+        return count > 1 ? m2 / (count - 1) : 0;
+    }
+};
+
+// A KLL quantile sketch (Karnin, Lang and Liberty): values are kept in
+// levels, where those of level h stand for 2^h values each. A full level
+// is sorted and every other value of it moves up a level. Higher levels
+// get more room, so that the rank error stays around 1/K.
+class QuantileSketch
+{
+private:
+    static const size_t K = 200;
+
+    std::vector<std::vector<double>> levels;
+    uint64_t n;
+
+    // Chooses which half of a level moves up. A fixed sequence keeps the
+    // summaries reproducible.
+    uint64_t coin;
+
+    size_t capacity(size_t h) const {
+        size_t depth = levels.size() - 1 - h;
+        return std::max<size_t>(2, size_t(std::ceil(K * std::pow(2.0 / 3, depth))));
+    }
+
+    void compact() {
+        for (size_t h = 0;h < levels.size();++h) {
+            if (levels[h].size() < capacity(h)) {
+                continue;
+            }
+            if (h + 1 == levels.size()) {
+                levels.emplace_back();
+            }
+            std::vector<double> & level = levels[h];
+            std::sort(level.begin(), level.end());
+            coin = coin * 6364136223846793005ULL + 1442695040888963407ULL;
+            size_t offset = coin >> 63;
+
+            // An odd one out stays.
+            double odd = 0;
+            bool has_odd = level.size() % 2 == 1;
+            if (has_odd) {
+                odd = level.back();
+                level.pop_back();
+            }
+            for (size_t i = offset;i < level.size();i += 2) {
+                levels[h + 1].push_back(level[i]);
+            }
+            level.clear();
+            if (has_odd) {
+                level.push_back(odd);
+            }
+        }
+    }
+
+public:
+    QuantileSketch():levels(1), n(0), coin(0) {}
+
+    uint64_t size() const {
+        return n;
+    }
+
+    void add(double x) {
+        levels[0].push_back(x);
+        ++n;
+        compact();
+    }
+
+    void merge(const QuantileSketch & other) {
+        if (levels.size() < other.levels.size()) {
+            levels.resize(other.levels.size());
+        }
+        for (size_t h = 0;h < other.levels.size();++h) {
+            levels[h].insert(levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+        }
+        n += other.n;
+        compact();
+    }
+
+    // The value with rank q * size(), q between 0 and 1.
+    double quantile(double q) const {
+        std::vector<std::pair<double, uint64_t>> weighted;
+        uint64_t total = 0;
+        for (size_t h = 0;h < levels.size();++h) {
+            for (auto x:levels[h]) {
+                weighted.push_back(std::make_pair(x, uint64_t(1) << h));
+                total += uint64_t(1) << h;
+            }
+        }
+        if (weighted.empty()) {
+            return 0;
+        }
+        std::sort(weighted.begin(), weighted.end());
+        double target = q * total;
+        uint64_t seen = 0;
+        for (auto &it:weighted) {
+            seen += it.second;
+            if (seen >= target) {
+                return it.first;
+            }
+        }
+        return weighted.back().first;
+    }
+
+    void encode(std::ostream & out) const {
+        out<<n<<" "<<coin<<" "<<levels.size();
+        for (auto &level:levels) {
+            out<<" "<<level.size();
+            for (auto x:level) out<<" "<<x;
+        }
+    }
+
+    bool decode(std::istream & in) {
+        size_t nlevels;
+        if (!(in>>n>>coin>>nlevels)) {
+            return false;
+        }
+        levels.assign(nlevels, std::vector<double>());
+        for (auto &level:levels) {
+            size_t size;
+            if (!(in>>size)) {
+                return false;
+            }
+            level.resize(size);
+            for (auto &x:level) {
+                if (!(in>>x)) return false;
+            }
+        }
+        return true;
+    }
+};
+
+// The summary of the values of a statistic.
+struct Summary
+{
+    RunningStats stats;
+    QuantileSketch sketch;
+
+    void add(double x) {
+        stats.add(x);
+        sketch.add(x);
+    }
+
+    void merge(const Summary & other) {
+        stats.merge(other.stats);
+        sketch.merge(other.sketch);
+    }
+
+    void print(std::ostream & out, const std::string & name) const {
+        std::streamsize precision = out.precision();
+        out<<std::setprecision(4)<<"  "<<name<<": "<<stats.count<<" values, mean "
+            <<stats.mean<<" (sd "<<std::sqrt(stats.variance())<<"), min "<<stats.min
+            <<", p1 "<<sketch.quantile(0.01)<<", p25 "<<sketch.quantile(0.25)
+            <<", median "<<sketch.quantile(0.5)<<", p75 "<<sketch.quantile(0.75)
+            <<", p99 "<<sketch.quantile(0.99)<<", max "<<stats.max<<"."<<std::endl;
+        out.precision(precision);
+    }
+};
+
+// The statistics collected by a property, by name. Values may be added
+// from several threads.
+class Statistics
+{
+private:
+    mutable std::mutex mutex;
+    std::map<std::string, Summary> summaries;
+
+public:
+    void add(const std::string & name, double x) {
+        std::lock_guard<std::mutex> lock(mutex);
+        summaries[name].add(x);
+    }
+
+    void merge(const std::map<std::string, Summary> & other) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &it:other) {
+            summaries[it.first].merge(it.second);
+        }
+    }
+
+    std::map<std::string, Summary> get() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return summaries;
+    }
+
+    std::string encode() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ostringstream out;
+        out.precision(17);
+        out<<summaries.size();
+        for (auto &it:summaries) {
+            const RunningStats & s = it.second.stats;
+            out<<" "<<it.first.size()<<":"<<it.first<<" "<<s.count<<" "<<s.mean<<" "
+                <<s.m2<<" "<<s.min<<" "<<s.max<<" ";
+            it.second.sketch.encode(out);
+        }
+        return out.str();
+    }
+
+    // Merges the statistics encoded in s. Returns false if it is truncated.
+    bool merge_encoded(const std::string & s) {
+        std::istringstream in(s);
+        size_t count;
+        if (!(in>>count)) {
+            return false;
+        }
+        std::map<std::string, Summary> decoded;
+        for (size_t k = 0;k < count;++k) {
+            size_t len;
+            char colon;
+            if (!(in>>len) || !in.get(colon)) {
+                return false;
+            }
+            std::string name(len, ' ');
+            if (len && !in.read(&name[0], len)) {
+                return false;
+            }
+            Summary & summary = decoded[name];
+            RunningStats & st = summary.stats;
+            if (!(in>>st.count>>st.mean>>st.m2>>st.min>>st.max) ||
+                    !summary.sketch.decode(in)) {
+                return false;
+            }
+        }
+        merge(decoded);
+        return true;
+    }
+
+    void print_results(std::ostream & out) const {
+        for (auto &it:get()) {
+            it.second.print(out, it.first);
+        }
+    }
+};
+
+// The statistics of the property running on this thread, if any.
+inline Statistics *& current_statistics()
+{
+    static thread_local Statistics * stats = nullptr;
+    return stats;
+}
+
+// Installs statistics as the current ones for its lifetime.
+struct StatisticsScope
+{
+    Statistics * previous;
+
+    StatisticsScope(Statistics * stats):previous(current_statistics()) {
+        current_statistics() = stats;
+    }
+
+    ~StatisticsScope() {
+        current_statistics() = previous;
+    }
+};
+
+} // namespace detail
+
+// Adds x to the statistic name of the property whose test is running on
+// this thread, e.g. the height of a tree or an elapsed time measured by
+// the property function. It is summarized and printed with the result.
+inline void collect(const std::string & name, double x)
+{
+    if (detail::Statistics * stats = detail::current_statistics()) {
+        // The summaries are not the property's allocations.
+        detail::AllocPhase phase = detail::alloc_phase();
+        detail::alloc_phase() = detail::ALLOC_OFF;
+        stats->add(name, x);
+        detail::alloc_phase() = phase;
+    }
+}
+
+} // namespace qcppc
+
+#endif // QCPPC_STATS_H_
@@ -0,0 +1,93 @@
+// A small persistent key/value store for qcppc.
+//
+// Records are kept in a plain text file, one "key<TAB>value" per line,
+// so that they survive between runs of a test binary (timings of previous
+// runs and the like) and can be inspected or deleted by hand.
+
+#ifndef QCPPC_STORE_H_
+#define QCPPC_STORE_H_
+
+#include <string>
+#include <map>
+#include <fstream>
+#include <cstdio>
+
+namespace qcppc {
+namespace detail {
+
+class RecordFile
+{
+private:
+    std::string path;
+    std::map<std::string, std::string> records;
+
+    // Keys and values as stored: tabs and newlines, which delimit the
+    // records, are replaced with spaces.
+    static std::string cleaned(std::string s)
+    {
+        for (auto &c:s) if (c == '\t' || c == '\n') c = ' ';
+        return s;
+    }
+
+public:
+    // Loads the records of the file at path. A missing or unreadable file
+    // is just an empty store.
+    RecordFile(const std::string & path):path(path)
+    {
+        std::ifstream in(path.c_str());
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t tab = line.find('\t');
+            if (tab != std::string::npos) {
+                records[line.substr(0, tab)] = line.substr(tab + 1);
+            }
+        }
+    }
+
+    bool has(const std::string & key) const
+    {
+        return records.count(cleaned(key)) > 0;
+    }
+
+    // Returns the value of key, or def if there is no such record.
+    std::string get(const std::string & key,
+            const std::string & def = std::string()) const
+    {
+        auto it = records.find(cleaned(key));
+        return it == records.end() ? def : it->second;
+    }
+
+    // Tabs and newlines in keys and values are replaced with spaces, for
+    // put as for the lookups.
+    void put(const std::string & key, const std::string & value)
+    {
+        records[cleaned(key)] = cleaned(value);
+    }
+
+    void erase(const std::string & key)
+    {
+        records.erase(cleaned(key));
+    }
+
+    // Writes the records back. The file is replaced atomically, so that
+    // an interrupted run never leaves it half written.
+    bool save() const
+    {
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream out(tmp.c_str());
+            for (auto &it:records) {
+                out<<it.first<<'\t'<<it.second<<'\n';
+            }
+            if (!out) {
+                return false;
+            }
+        }
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+};
+
+} // namespace detail
+} // namespace qcppc
+
+#endif // QCPPC_STORE_H_
@@ -0,0 +1,256 @@
+// Streaming inputs for qcppc.
+//
+// A Stream<T> stands for a sequence of values of T that may be far too
+// long to keep in memory, e.g. gigabytes of bytes for a stream processor:
+//
+//     qcppc::property([](const qcppc::Stream<char> & s){...})
+//         .Rnd<0>(qcppc::Arbitrary<qcppc::Stream<char>>(0, 1ull << 32))
+//         ();
+//
+// Its elements are drawn lazily, in blocks of constant size, from an
+// engine seeded with the seed of the stream, so that a stream is only
+// its length, its seed and its element generator. Every pass over it,
+// with iterators or with a Reader in chunks of any size, draws the same
+// elements, and a failing stream is reported by its seed, from which it
+// can be built again.
+
+#ifndef QCPPC_STREAM_H_
+#define QCPPC_STREAM_H_
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#include "generator.hpp"
+#include "printer.hpp"
+
+namespace qcppc {
+
+template<typename T>
+class Stream
+{
+public:
+    typedef T value_type;
+
+    // The elements are drawn in blocks of this many, whatever the reads.
+    static const size_t BLOCK = 4096;
+
+private:
+    // The element generator, shared by the copies and passes, or null for
+    // Arbitrary<T>. Integral elements of the latter are filled with random
+    // bytes (see detail::byte_fillable), without edge cases.
+    std::shared_ptr<Generator<T>> gen;
+    uint64_t length;
+    uint64_t stream_seed;
+
+public:
+    Stream():length(0), stream_seed(0) {}
+
+    // The stream of length elements of Arbitrary<T> drawn from seed.
+    Stream(uint64_t length, uint64_t seed):length(length), stream_seed(seed) {}
+
+    // The stream of length elements of gen drawn from seed. The
+    // property's rate of edge cases (see Property::Edges) doesn't apply,
+    // so that the elements depend on these only.
+    Stream(const std::function<T()> & gen, uint64_t length, uint64_t seed):
+        Stream(std::make_shared<Generator<T>>(gen), length, seed)
+    {}
+
+    // Same as above, with a generator shared with other streams.
+    Stream(const std::shared_ptr<Generator<T>> & gen, uint64_t length, uint64_t seed):
+        gen(gen), length(length), stream_seed(seed)
+    {}
+
+    uint64_t size() const {
+        return length;
+    }
+
+    uint64_t seed() const {
+        return stream_seed;
+    }
+
+    // Reads the elements of a stream in order, from the first, in chunks
+    // of any size. Holds one block of them.
+    class Reader
+    {
+    private:
+        Stream<T> stream;
+        detail::Engine engine;
+        std::vector<T> block;
+        size_t next;
+        uint64_t left;
+
+        void fill() {
+            size_t n = size_t(std::min<uint64_t>(left, BLOCK));
+            block.resize(n);
+            next = 0;
+            detail::EngineScope engine_scope(&engine);
+            detail::EdgeScope edge_scope(0, nullptr);
+            if constexpr (detail::byte_fillable<T>::value) {
+                if (!stream.gen) {
+                    detail::fill_random_bytes(block.data(), n * sizeof(T));
+                    return;
+                }
+            }
+            if (!stream.gen) {
+                // Kept in this reader's copy of the stream for its next
+                // blocks; other passes make their own.
+                detail::AllocOffScope off;
+                stream.gen = std::make_shared<Generator<T>>();
+            }
+            for (auto &t:block) {
+                t = (*stream.gen)();
+            }
+        }
+
+    public:
+        Reader(const Stream<T> & stream):
+            stream(stream), engine(detail::Engine::result_type(
+                    stream.stream_seed ^ (stream.stream_seed >> 32))),
+            next(0), left(stream.length)
+        {}
+
+        // Moves up to n more elements to out. Returns how many, 0 at the
+        // end of the stream.
+        size_t read(T * out, size_t n) {
+            size_t done = 0;
+            while (done < n) {
+                if (next == block.size()) {
+                    if (left == 0) {
+                        break;
+                    }
+                    fill();
+                    left -= block.size();
+                }
+                size_t k = std::min(n - done, block.size() - next);
+                std::move(block.begin() + next, block.begin() + next + k, out + done);
+                next += k;
+                done += k;
+            }
+            return done;
+        }
+
+        // Moves the next element to t. Returns false at the end instead.
+        bool read(T & t) {
+            return read(&t, 1) == 1;
+        }
+    };
+
+    // A single pass over the stream. Its copies share the position, as
+    // those of std::istream_iterator.
+    class iterator
+    {
+    private:
+        std::shared_ptr<Reader> reader;
+        T value;
+
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T * pointer;
+        typedef const T & reference;
+
+        // The end of any stream.
+        iterator() {}
+
+        iterator(const Stream<T> & stream):reader(std::make_shared<Reader>(stream)) {
+            ++*this;
+        }
+
+        const T & operator*() const {
+            return value;
+        }
+
+        const T * operator->() const {
+            return &value;
+        }
+
+        iterator & operator++() {
+            if (!reader->read(value)) {
+                reader.reset();
+            }
+            return *this;
+        }
+
+        void operator++(int) {
+            ++*this;
+        }
+
+        bool operator==(const iterator & other) const {
+            return reader == other.reader;
+        }
+
+        bool operator!=(const iterator & other) const {
+            return reader != other.reader;
+        }
+    };
+
+    typedef iterator const_iterator;
+
+    // Starts a new pass, which draws the same elements as the others.
+    iterator begin() const {
+        return iterator(*this);
+    }
+
+    iterator end() const {
+        return iterator();
+    }
+
+    Reader reader() const {
+        return Reader(*this);
+    }
+};
+
+// Prints the first elements of the stream, however printing is limited
+// (see qcppc::limit_printing), and its length and seed.
+template<typename T>
+std::ostream& operator<<(std::ostream & out, const Stream<T> & s)
+{
+    size_t limit = detail::print_limits().elements;
+    uint64_t n = std::min<uint64_t>(s.size(), limit ? limit : 100);
+    typename Stream<T>::Reader reader = s.reader();
+    out<<"S<";
+    T t;
+    for (uint64_t i = 0;i < n && reader.read(t);++i) {
+        detail::print_helper(out, t)<<", ";
+    }
+    if (n < s.size()) {
+        out<<"... "<<s.size() - n<<" more, ";
+    }
+    return out<<s.size()<<" in all, seed "<<s.seed()<<">";
+}
+
+// Arbitrary specialization for streams, of a length between low and high
+// (inclusive) and a random seed.
+template<typename T>
+struct Arbitrary<Stream<T>> : ArbitraryBase
+{
+    std::uniform_int_distribution<uint64_t> length;
+    std::shared_ptr<Generator<T>> gen;
+
+    Arbitrary(uint64_t low = 0, uint64_t high = MAX_LEN):length(low, high) {
+        assert(low <= high);
+    }
+
+    // Uses gen as the generator for the elements.
+    Arbitrary(const std::function<T()> & gen, uint64_t low = 0, uint64_t high = MAX_LEN):
+        length(low, high), gen(std::make_shared<Generator<T>>(gen)) {
+        assert(low <= high);
+    }
+
+    Stream<T> operator()() {
+        uint64_t n = length(engine);
+        uint64_t seed = uint64_t(engine()) << 32;
+        seed |= engine();
+        return Stream<T>(gen, n, seed);
+    }
+};
+
+} // namespace qcppc
+
+#endif // QCPPC_STREAM_H_
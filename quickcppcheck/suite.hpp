@@ -0,0 +1,201 @@
+// Test registry and suite runner for qcppc.
+//
+// Tests are registered with QCPPC_TEST and run with qcppc::run_suite,
+// concurrently on a pool of threads. Every test reports to its own buffer,
+// which is printed in one piece when the test is done.
+//
+//     QCPPC_TEST(insert_keeps_bst) {
+//         return qcppc::property(...)();
+//     }
+//
+//     int main(int argc, char **argv) {
+//         return qcppc::run_suite(argc, argv);
+//     }
+
+#ifndef QCPPC_SUITE_H_
+#define QCPPC_SUITE_H_
+
+#include <iostream>
+#include <sstream>
+#include <functional>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+#include "property.hpp"
+#include "store.hpp"
+
+namespace qcppc {
+namespace detail {
+
+struct TestCase
+{
+    std::string name;
+    std::function<bool()> fun;
+
+    // Exclusive tests run alone, after all the others, e.g. because
+    // they measure time.
+    bool exclusive;
+};
+
+inline std::vector<TestCase> & registry()
+{
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+struct Registrar
+{
+    Registrar(const char * name, bool (*fun)(), bool exclusive) {
+        registry().push_back(TestCase{name, fun, exclusive});
+    }
+};
+
+} // namespace detail
+
+// Defines and registers a test. The body follows the macro and returns
+// true if the test passed.
+#define QCPPC_TEST(name) QCPPC_REGISTER_TEST(name, false)
+
+// Same as QCPPC_TEST, only the test never runs concurrently with others.
+#define QCPPC_TEST_EXCLUSIVE(name) QCPPC_REGISTER_TEST(name, true)
+
+#define QCPPC_REGISTER_TEST(name, exclusive) \
+    static bool name(); \
+    static ::qcppc::detail::Registrar name##_registrar(#name, name, exclusive); \
+    static bool name()
+
+// Runs the registered tests and returns the exit code for main:
+// 0 if all of them passed, 1 otherwise.
+//
+// Command line arguments:
+//  filters: run only the tests whose name contains one of them.
+//  -j N: run up to N tests at once (default: the number of cores).
+//  --timings FILE: where the timings of previous runs are kept
+//      (default: .qcppc_timings). The tests that took longest last time
+//      start first, so that a slow test doesn't finish alone at the end.
+//  --list: print the names of the tests and exit.
+inline int run_suite(int argc, char ** argv)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    std::vector<std::string> filters;
+    std::string timings_path = ".qcppc_timings";
+    unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool list = false;
+
+    for (int i = 1;i < argc;++i) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            jobs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--timings" && i + 1 < argc) {
+            timings_path = argv[++i];
+        } else if (arg == "--list") {
+            list = true;
+        } else {
+            filters.push_back(arg);
+        }
+    }
+
+    std::vector<detail::TestCase> tests;
+    for (auto &t:detail::registry()) {
+        bool selected = filters.empty();
+        for (auto &f:filters) {
+            selected = selected || t.name.find(f) != std::string::npos;
+        }
+        if (selected) {
+            tests.push_back(t);
+        }
+    }
+
+    if (list) {
+        for (auto &t:tests) std::cout<<t.name<<std::endl;
+        return 0;
+    }
+
+    // Longest expected first. Tests without a previous timing may be slow
+    // ones too, so they are expected to take the longest.
+    detail::RecordFile timings(timings_path);
+    std::vector<double> expected;
+    for (auto &t:tests) {
+        expected.push_back(timings.has(t.name) ?
+                std::atof(timings.get(t.name).c_str()) : 1e300);
+    }
+    std::vector<size_t> order;
+    for (size_t i = 0;i < tests.size();++i) order.push_back(i);
+    std::stable_sort(order.begin(), order.end(),
+            [&tests, &expected](size_t a, size_t b) {
+                if (tests[a].exclusive != tests[b].exclusive) return !tests[a].exclusive;
+                return expected[a] > expected[b];
+            });
+
+    std::vector<char> passed(tests.size(), false);
+    std::vector<double> elapsed(tests.size(), 0);
+    std::mutex print_mutex;
+
+    auto run_one = [&](size_t i) {
+        std::ostringstream buffer;
+        std::ostream * previous = detail::output_stream();
+        detail::output_stream() = &buffer;
+        auto start = Clock::now();
+        passed[i] = tests[i].fun();
+        elapsed[i] = std::chrono::duration<double>(Clock::now() - start).count();
+        detail::output_stream() = previous;
+
+        std::lock_guard<std::mutex> lock(print_mutex);
+        std::cout<<buffer.str();
+        std::cout.flush();
+    };
+
+    auto suite_start = Clock::now();
+
+    std::atomic<size_t> next(0);
+    size_t shared = std::count_if(tests.begin(), tests.end(),
+            [](const detail::TestCase & t) { return !t.exclusive; });
+    std::vector<std::thread> workers;
+    for (unsigned int j = 0;j < std::min<size_t>(jobs, shared);++j) {
+        workers.push_back(std::thread([&]() {
+            // Sharded properties run in this process, see Property::Shards.
+            detail::forking_disabled() = true;
+            for (size_t k = next++;k < shared;k = next++) {
+                run_one(order[k]);
+            }
+        }));
+    }
+    for (auto &w:workers) w.join();
+    for (size_t k = shared;k < tests.size();++k) {
+        run_one(order[k]);
+    }
+
+    double total = std::chrono::duration<double>(Clock::now() - suite_start).count();
+
+    for (size_t i = 0;i < tests.size();++i) {
+        std::ostringstream ss;
+        ss<<elapsed[i];
+        timings.put(tests[i].name, ss.str());
+    }
+    timings.save();
+
+    size_t failed = std::count(passed.begin(), passed.end(), false);
+    std::cout<<"======================================"<<std::endl;
+    if (failed == 0) {
+        std::cout<<MAKE_GREEN("+++ OK,")<<" passed "<<tests.size()<<" tests in "
+            <<total<<"s."<<std::endl;
+    } else {
+        std::cout<<MAKE_RED("*** Failed")<<" "<<failed<<" of "<<tests.size()
+            <<" tests in "<<total<<"s:"<<std::endl;
+        for (size_t i = 0;i < tests.size();++i) {
+            if (!passed[i]) std::cout<<"  "<<tests[i].name<<std::endl;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+} // namespace qcppc
+
+#endif // QCPPC_SUITE_H_
@@ -3,71 +3,113 @@
 #ifndef QCPPC_UTILS_H_
 #define QCPPC_UTILS_H_
 
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
 namespace qcppc {
 namespace utils {
 
 //---------------------------------------------------------------
-// Applies a function on a tuple.
-// Extract one element from the tuple each time and apply
-// recursively for the rest.
-template<std::size_t N>
-struct apply_func {
-    template<typename F, typename... Types, typename... Args>
-    static typename F::result_type
-            apply(F & f,
-                  std::tuple<Types...> & data,
-                  Args&... args)
-    {
-        return apply_func<N-1>::apply(f, data, std::get<N-1>(data), args...);
-    }
-};
-
-// Base case; no more elements to extract, just call the function.
-template<>
-struct apply_func<0> {
-    template<typename F, typename... Types, typename... Args>
-    static typename F::result_type
-            apply(F & f,
-                  std::tuple<Types...> & data,
-                  Args&... args)
-    {
-        return f(args...);
-    }
-};
+// Applies a function on the elements of a tuple.
+template<typename F, typename Data>
+decltype(auto) apply_func(F & f, Data & data)
+{
+    return std::apply(f, data);
+}
 
 //--------------------------------------------------------------
 // Gets a tuple of functions and a tuple of arguments and applies each
 // function to the corresponding argument.
-template<std::size_t N>
-struct apply_func_individually {
-    template<typename Funs, typename Data>
-    static void apply(Funs & funs, Data & data)
-    {
-        std::get<N-1>(data) = std::get<N-1>(funs)();
-        apply_func_individually<N-1>::apply(funs, data);
+template<typename Funs, typename Data, std::size_t... I>
+void apply_func_individually(Funs & funs, Data & data, std::index_sequence<I...>)
+{
+    ((std::get<I>(data) = std::get<I>(funs)()), ...);
+}
+
+template<typename Funs, typename Data>
+void apply_func_individually(Funs & funs, Data & data)
+{
+    apply_func_individually(funs, data,
+            std::make_index_sequence<std::tuple_size<Data>::value>());
+}
+
+//--------------------------------------------------------------
+// Same as apply_func_individually, except that for the positions
+// where index is not NOT_ENUMERATED the value is taken from the finite
+// domain of the generator instead (see Generator::at), and for those
+// where it is KEPT the value in data is left as it is.
+static const std::size_t NOT_ENUMERATED = std::size_t(-1);
+static const std::size_t KEPT = std::size_t(-2);
+
+template<typename Fun, typename T>
+void enumerate_one(Fun & fun, T & t, std::size_t index)
+{
+    if (index == KEPT) {
+        return;
+    } else if (index == NOT_ENUMERATED) {
+        t = fun();
+    } else {
+        t = fun.at(index);
     }
-};
+}
 
-// Base case; nothing to do, just stop the recursion.
-template<>
-struct apply_func_individually<0> {
-    template<typename Funs, typename Data>
-    static void apply(Funs & funs, Data & data)
-    {}
-};
+template<typename Funs, typename Data, std::size_t... I>
+void enumerate_individually(Funs & funs, Data & data,
+        const std::vector<std::size_t> & index, std::index_sequence<I...>)
+{
+    (enumerate_one(std::get<I>(funs), std::get<I>(data), index[I]), ...);
+}
+
+template<typename Funs, typename Data>
+void enumerate_individually(Funs & funs, Data & data,
+        const std::vector<std::size_t> & index)
+{
+    enumerate_individually(funs, data, index,
+            std::make_index_sequence<std::tuple_size<Data>::value>());
+}
+
+//--------------------------------------------------------------
+// Collects the domain sizes of a tuple of generators.
+template<typename... Funs>
+std::vector<std::size_t> domain_sizes(const std::tuple<Funs...> & funs)
+{
+    return std::apply([](const Funs &... fun) {
+                return std::vector<std::size_t>{fun.domain_size...};
+            }, funs);
+}
 
 //--------------------------------------------------------------
 //Find the type at POS position in argument pack Args.
-template<size_t POS, typename T, typename...Args>
+template<size_t POS, typename...Args>
 struct get_type_at
 {
-    typedef typename get_type_at<POS - 1, Args...>::type type;
+    typedef typename std::decay<
+            typename std::tuple_element<POS, std::tuple<Args...>>::type
+        >::type type;
+};
+
+//-------------------------------------------------------------
+// How an argument of type Arg is passed to the property function: as an
+// lvalue, except that it is moved in when the function takes it by rvalue
+// reference, or by value and its type can't be copied (e.g.
+// std::unique_ptr).
+template<typename Arg>
+struct moved_in
+{
+    enum { value = std::is_rvalue_reference<Arg>::value ||
+        (!std::is_reference<Arg>::value && !std::is_copy_constructible<Arg>::value) };
 };
 
-template<typename T, typename...Args>
-struct get_type_at<0, T, Args...>
+template<typename Arg>
+struct passed_type
 {
-    typedef typename std::decay<T>::type type;
+    typedef typename std::conditional<moved_in<Arg>::value,
+            typename std::decay<Arg>::type &&,
+            typename std::conditional<std::is_lvalue_reference<Arg>::value,
+                Arg, typename std::decay<Arg>::type &>::type
+        >::type type;
 };
 
 //-------------------------------------------------------------
@@ -126,6 +168,18 @@ struct Unpack<std::tuple<Args...>, Target>
     typedef Target<Args...> type;
 };
 
+// Checks whether a generator of type T knows its finite domain, that is,
+// it has the member functions size_t domain_size() const and
+// value_type at(size_t) const.
+template<typename T>
+struct has_domain
+{
+    template<typename U> static char test(decltype(&U::domain_size));
+    template<typename U> static int test(...);
+
+    enum { value = sizeof(test<T>(0)) == 1 };
+};
+
 template<typename T>
 struct is_printable
 {
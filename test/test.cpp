@@ -1,8 +1,29 @@
 #include <iostream>
 #include <set>
+#include <deque>
+#include <mutex>
 #include <algorithm>
+#include <cstdio>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <cstdlib>
+#include <stdexcept>
+#include <unistd.h>
 
+// The allocations of the tests are counted, see test_allocations.
+#define QCPPC_COUNT_ALLOCATIONS
 #include "../quickcppcheck/property.hpp"
+#include "../quickcppcheck/complexity.hpp"
+#include "../quickcppcheck/distribution.hpp"
+#include "../quickcppcheck/combinators.hpp"
+#include "../quickcppcheck/coroutine.hpp"
+#include "../quickcppcheck/stateful.hpp"
+#include "../quickcppcheck/stream.hpp"
 
 #define _1K   1000
 #define _10K  10000
@@ -14,6 +35,53 @@
 
 using namespace qcppc;
 
+// The number of checks and properties that failed, see check and expect.
+int failures = 0;
+
+// Runs prop, with the arguments args, and returns what it reported.
+template<typename P, typename... A>
+std::string report_of(P prop, bool & ok, A... args)
+{
+    std::ostringstream report;
+    detail::output_stream() = &report;
+    ok = prop(args...);
+    detail::output_stream() = &std::cout;
+    return report.str();
+}
+
+// Prints the result of the check name, with what was reported if it
+// didn't pass, and counts it if so.
+void check(const std::string & name, bool passed, const std::string & note,
+        const std::string & report)
+{
+    std::cout<<"Property: "<<MAKE_YELLOW(name)<<std::endl;
+    if (passed) {
+        std::cout<<MAKE_GREEN("+++ OK,")<<" "<<note<<std::endl<<std::endl;
+    } else {
+        ++failures;
+        std::cout<<MAKE_RED("*** Failed,")<<" got:"<<std::endl<<report<<std::endl;
+    }
+}
+
+// Counts a property that should have passed and didn't. It reported
+// itself.
+bool expect(bool passed)
+{
+    failures += !passed;
+    return passed;
+}
+
+// A new empty file, for the tests that write one.
+std::string temp_path()
+{
+    char path[] = "/tmp/qcppc_test_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        close(fd);
+    }
+    return path;
+}
+
 template<typename T>
 struct prop_mean
 {
@@ -105,7 +173,7 @@ void test_arbit_bounded()
         "Mean value of Arbitrary<double>() with x >= 0 should be close to 0.5")
         //<  Acceptor<double>([] (double x) { return x >= 0; }
         .Rnd<0>(Arbitrary<double>())
-        .If(std::bind2nd(std::greater_equal<double>(), 0))
+        .If(std::bind(std::greater_equal<double>(), std::placeholders::_1, 0))
     (_10M, 0.7);
 
     property(prop_mean<float>(_10M, -13., 0.01, true),
@@ -116,7 +184,7 @@ void test_arbit_bounded()
     property(prop_mean<float>(_10M, -0.25, 0.01, true),
         "Mean value of Arbitrary<float>() whith x < 0.5 should be close to -0.25")
         .Rnd<0>(Arbitrary<float>())
-        .If(std::bind2nd(std::less<double>(), 0.5))
+        .If(std::bind(std::less<double>(), std::placeholders::_1, 0.5))
      (_10M);
 
     property(prop_mean<float>(_10M, 3.7, 0.01, true),
@@ -176,7 +244,786 @@ void test_vector()
     (_1K);
 }
 
+void test_exhaustive()
+{
+    std::set<std::pair<bool, int>> seen;
+    expect(property([&seen] (bool b, int n, char c)
+                    { return seen.insert(std::make_pair(b, n)).second && c == 'x'; },
+        "Exhaustive mode should run every combination exactly once.")
+        .Rnd<1>(-5, 5)
+        .Fix<2>('x')
+        .Exhaustive()
+    (_1K));
+
+    expect(property([] (bool b, int n) { return n >= 0 && n <= 100; },
+        "Exhaustive mode should enumerate the bool and sample the int.")
+        .Rnd<1>(0, 100)
+        .Frq<0>({{true, 2}, {false, 1}})
+        .Exhaustive()
+        .Classify([] (bool b, int n) { return b ? "true" : "false"; })
+    (100));
+}
+
+void test_dedup()
+{
+    std::set<std::pair<int, std::string>> seen;
+    expect(property([&seen] (int n, const std::string & s)
+                    { return seen.insert(std::make_pair(n, s)).second; },
+        "Dedup should never run the same input twice.")
+        .Rnd<0>(1, 20)
+        .One<1>({"a", "b", "c"})
+        .Dedup()
+    (_10K));
+}
+
+void test_cache()
+{
+    std::string path = temp_path();
+    int runs = 0;
+    auto prop = property([&runs] (int n) { ++runs; (void)n; return true; },
+        "A cached property should not run again.");
+
+    use_cache(path);
+    prop(100);
+    use_cache(path);
+    prop(100);
+
+    // Reduced reruns draw inputs that the previous runs did not.
+    std::vector<std::vector<int>> drawn(3);
+    std::vector<int> * sink = nullptr;
+    auto recorded = property([&sink] (int n) { sink->push_back(n); return true; },
+        "A rerun of a cached property should draw new inputs.", 0);
+    for (auto &inputs:drawn) {
+        use_cache(path, 0.1);
+        sink = &inputs;
+        recorded(100);
+    }
+    use_cache("");
+    std::remove(path.c_str());
+
+    // The inputs depend on the name only, not on the properties created
+    // before.
+    std::vector<int> after;
+    property([] (int) { return true; }, "Another property.", 0)(10);
+    property([&after] (int n) { after.push_back(n); return true; },
+        "A rerun of a cached property should draw new inputs.", 0)(10);
+
+    check("Cached properties should be skipped, or rerun with new inputs.",
+        runs == 100 && drawn[1].size() == 10 && drawn[2].size() == 10 &&
+            !std::equal(drawn[1].begin(), drawn[1].end(), drawn[0].begin()) &&
+            drawn[1] != drawn[2] && after == std::vector<int>(drawn[0].begin(),
+                drawn[0].begin() + 10),
+        "they were.",
+        std::to_string(runs) + " tests run, or reduced reruns drew the same inputs, or"
+            " the inputs depend on the creation order.\n");
+}
+
+void test_combinators()
+{
+    auto even = [](int x) { return x % 2 == 0; };
+    auto square = [](int x) { return x * x; };
+    expect(property([] (int x) { int r = std::lround(std::sqrt(x));
+                          return r * r == x && r % 2 == 0 && r <= 100; },
+        "map(filter(...)) should produce the squares of even numbers.")
+        .Rnd<0>(gen::map(gen::filter(Arbitrary<int>(0, 100), even), square))
+    ());
+
+    expect(property([] (const std::tuple<int, std::vector<int>> & t)
+                    { return std::get<1>(t).size() == size_t(std::get<0>(t)); },
+        "bind should generate vectors of the size generated first.")
+        .Rnd<0>(gen::bind(Arbitrary<int>(0, 10), [](int n) {
+                    return gen::zip(Fixed<int>(n), Arbitrary<std::vector<int>>(n, n)); }))
+    ());
+
+    std::set<std::tuple<bool, int>> pairs;
+    expect(property([&pairs] (const std::tuple<bool, int> & t)
+                    { return pairs.insert(t).second; },
+        "zip should enumerate all the pairs exactly once.")
+        .Rnd<0>(gen::zip(Arbitrary<bool>(), Arbitrary<int>(1, 3)))
+        .Exhaustive()
+    ());
+
+    std::set<int> values;
+    expect(property([&values] (int x) { return values.insert(x).second; },
+        "oneof should enumerate the values of all its generators.")
+        .Rnd<0>(gen::map(gen::oneof(Fixed<int>(1), Arbitrary<int>(10, 12)),
+                    [](int x) { return -x; }))
+        .Exhaustive()
+    ());
+
+    // A full range isn't enumerable (0), and neither is a sum that
+    // overflows.
+    size_t unbounded = gen::oneof(Fixed<long long>(1), Arbitrary<long long>()).domain_size();
+    size_t overflowing = gen::oneof(Fixed<unsigned long long>(1),
+            Arbitrary<unsigned long long>(0, -1ULL - 1)).domain_size();
+    bool ok;
+    std::string report = report_of(property([] (long long) { return true; },
+        "oneof with a generator that isn't enumerable should run random tests.")
+        .Rnd<0>(gen::oneof(Fixed<long long>(1), Arbitrary<long long>()))
+        .Exhaustive(), ok);
+    check("oneof should only be enumerable if all its generators are.",
+        unbounded == 0 && overflowing == 0 && ok &&
+            report.find("exhaustively") == std::string::npos,
+        "it was.", report);
+}
+
+void test_coroutines()
+{
+#ifdef QCPPC_HAS_COROUTINES
+    int last = -1;
+    expect(property([&last] (int k) { bool ok = k > last; last = k; return ok; },
+        "A coroutine should generate increasing keys.")
+        .Rnd<0>(gen::coroutine([]() -> Coroutine<int> {
+                    Arbitrary<int> step(1, 10);
+                    for (int k = 0;;) co_yield k += step();
+                }))
+    ());
+
+    int expected = 0;
+    expect(property([&expected] (int k) { bool ok = k == expected; expected = (k + 1) % 3; return ok; },
+        "A coroutine that ends should start over.")
+        .Rnd<0>(gen::coroutine([]() -> Coroutine<int> {
+                    for (int k = 0;k < 3;++k) co_yield k;
+                }))
+    ());
+
+    expect(property([] (int k) { return detail::current_frame_pool() != nullptr; },
+        "A property with a coroutine generator should have a frame pool.")
+        .Rnd<0>(gen::coroutine([]() -> Coroutine<int> { co_yield 0; }))
+    (10));
+
+    expect(property([] (int k) { return detail::current_frame_pool() == nullptr; },
+        "A property without one should have none.")
+    (10));
+#endif
+}
+
+void test_async()
+{
+    std::atomic<int> in_flight(0), max_in_flight(0);
+    expect(property([&] (int) {
+                return std::async(std::launch::async, [&]() {
+                        int n = ++in_flight;
+                        for (int m = max_in_flight; n > m && !max_in_flight.compare_exchange_weak(m, n);) {}
+                        std::this_thread::sleep_for(std::chrono::microseconds(200));
+                        --in_flight;
+                        return true;
+                    }); },
+        "Asynchronous tests should run concurrently.")
+        .Concurrency(8)
+    (200));
+
+    // Later tests finish first, yet the first failure should be reported.
+    bool ok;
+    std::string report = report_of(property([] (int x) {
+                return std::async(std::launch::async, [x]() {
+                        std::this_thread::sleep_for(std::chrono::microseconds(50 * (60 - x % 60)));
+                        return x % 50 != 0;
+                    }); })
+        .Rnd<0>([n = 0]() mutable { return ++n; })
+        .Concurrency(16), ok, 200);
+    check("Asynchronous properties should run concurrently and report the first failure.",
+        max_in_flight >= 2 && !ok && report.find("after 50 tests") != std::string::npos,
+        "reported input 50.",
+        "at most " + std::to_string(max_in_flight) + " tests at once, and\n" + report);
+
+    // A deferred future never becomes ready by itself.
+    expect(property([] (int x) {
+                return std::async(std::launch::deferred, [x]() { return std::abs(x % 2) <= 1; }); },
+        "Deferred asynchronous tests should run when collected.")
+        .Concurrency(4)
+    (100));
+}
+
+void test_perf()
+{
+    expect(property([] (const std::vector<int> & v)
+                    { return std::accumulate(v.begin(), v.end(), 0L) >= -(1L << 62); },
+        "Perf should measure every call, with or without counters.")
+        .Rnd<0>(0, 500)
+        .Classify([](const std::vector<int> & v) { return v.size() < 250 ? "short" : "long"; })
+        .Perf()
+    ());
+}
+
+// Keeps the busy loops of test_baseline from being optimized away.
+volatile int baseline_sink;
+
+void test_baseline()
+{
+    std::string path = temp_path();
+    auto busy = [](int n) { for (int i = 0;i < n;++i) baseline_sink = i; return true; };
+
+    expect(property([&busy] (int) { return busy(1000); },
+        "A baseline is recorded on the first run.")
+        .Baseline(path, 0.2)
+    ());
+
+    bool ok;
+    std::string report = report_of(property([&busy] (int) { return busy(5000); },
+        "A baseline is recorded on the first run.")
+        .Baseline(path, 0.2), ok);
+    std::remove(path.c_str());
+
+    check("A slower property should fail against its baseline.",
+        !ok && report.find("Slower") != std::string::npos, "it failed.", report);
+
+    // Keys are cleaned for the lookups as they are when stored, e.g. the
+    // names of properties with tabs.
+    detail::RecordFile records(path);
+    records.put("a\tproperty", "1");
+    bool found = records.has("a\tproperty") && records.get("a\tproperty") == "1";
+    records.erase("a\tproperty");
+    check("Records should be found by the keys they were stored with.",
+        found && !records.has("a\tproperty"), "they were.", "");
+}
+
+// Keeps the leaks of test_allocations from being optimized away.
+int * volatile leak_sink;
+
+void test_allocations()
+{
+    expect(property([] (const std::vector<int> & v)
+                    { std::vector<int> w(v); std::sort(w.begin(), w.end());
+                      return w.size() == v.size(); },
+        "Copies freed by the property should neither leak nor exceed the budget.")
+        .Rnd<0>(0, 100)
+        .NoLeaks()
+        .MaxAllocations(1)
+    ());
+
+    bool ok;
+    std::string report = report_of(property([] (int n) { leak_sink = new int(n); return true; },
+        "This leaks.")
+        .NoLeaks(), ok);
+    delete leak_sink;
+
+    check("A property that leaks should fail.",
+        !ok && report.find("leaked 1 objects") != std::string::npos, "it failed.", report);
+
+    // The leaking input is only printed once destroyed, by drawing it
+    // again, discarded inputs included.
+    int leaked = 0;
+    std::string redrawn = report_of(property([&leaked] (int n)
+                    { if (n % 5 == 0) { leaked = n; leak_sink = new int(n); } return true; },
+                "This leaks on multiples of 5.")
+                .Rnd<0>(1000000, 9999999)
+                .If([] (int n) { return n % 2 == 0; })
+                .NoLeaks(), ok);
+    delete leak_sink;
+
+    check("A leaking input should be reported as the property got it.",
+        !ok && leaked && redrawn.find(std::to_string(leaked)) != std::string::npos,
+        "it was.", "leaked on " + std::to_string(leaked) + ":\n" + redrawn);
+
+    // Its first test frees a block allocated before the property ran, and
+    // leaks one.
+    int * before = new int(0);
+    std::string freeing = report_of(property([&before] (int n)
+                    { if (before) { delete before; before = nullptr; leak_sink = new int(n); }
+                      return true; },
+                "This leaks and frees an older block.")
+                .NoLeaks()
+                .Rnd<0>(0, 10), ok);
+    delete leak_sink;
+
+    check("Freeing older blocks shouldn't hide a leak.",
+        !ok && freeing.find("leaked 1 objects") != std::string::npos, "it failed.", freeing);
+}
+
+void test_shards()
+{
+    // Copies of a property draw the same inputs.
+    auto passing = property([] (int x, int y) { return std::max(x, y) >= y; },
+        "Sharded runs should report the same as a single process.")
+        .Rnd<0>(-100, 100)
+        .If([] (int x, int) { return x % 5 != 0; })
+        .Classify([] (int x, int) { return x < 0 ? "negative" : "positive"; });
+    auto failing = property([] (int x) { return x < 190; },
+        "Sharded runs should report the same first failure.")
+        .Rnd<0>(0, 200)
+        .Classify([] (int x) { return x < 100 ? "small" : "large"; });
+
+    bool ok1, ok2, ok3, ok4, ok5;
+    std::string single = report_of(passing, ok1);
+    std::string sharded = report_of(passing.Shards(3), ok2);
+    std::string single_failure = report_of(failing, ok3);
+    std::string sharded_failure = report_of(failing.Shards(4), ok4);
+    std::string crash = report_of(property([] (int x) { if (x > 150) std::_Exit(1); return true; },
+        "A worker that dies should fail the property.")
+        .Rnd<0>(0, 200)
+        .Shards(2), ok5);
+
+    check("Sharded runs should merge like a single process.",
+        ok1 && ok2 && single == sharded && !ok3 && !ok4 && single_failure == sharded_failure &&
+            !ok5 && crash.find("died") != std::string::npos,
+        "they did.", single + sharded + single_failure + sharded_failure + crash);
+
+    // The exception must not unwind into the worker's main, which would
+    // run the rest of the program again.
+    bool ok8;
+    std::string thrown = report_of(property([] (int x) {
+                if (x == 7) throw std::runtime_error("seven");
+                return true; },
+        "A property that throws in a worker should fail with its input.")
+        .Fix<0>(7)
+        .Shards(2), ok8);
+
+    check("A worker that throws should report the test and the input.",
+        !ok8 && thrown.find("after 1 tests, threw seven.") != std::string::npos &&
+            thrown.find("7") != std::string::npos &&
+            thrown.find("unknown input") == std::string::npos,
+        "it did.", thrown);
+
+#ifdef QCPPC_HAS_FORK
+    // Neither a thread that must not fork, as a worker of run_suite, nor
+    // QCPPC_SHARDS for a property with Cover should run workers.
+    pid_t parent = getpid();
+    auto in_parent = [parent] (int) { return getpid() == parent; };
+    bool ok6 = false, ok7;
+    std::string from_worker;
+    std::thread([&]() {
+                detail::forking_disabled() = true;
+                from_worker = report_of(property(in_parent, "").Shards(2), ok6);
+            }).join();
+    setenv("QCPPC_SHARDS", "2", 1);
+    std::string covered = report_of(property(in_parent, "")
+        .Classify([] (int x) { return x < 0 ? "negative" : "positive"; })
+        .Cover("positive", 10), ok7);
+    unsetenv("QCPPC_SHARDS");
+
+    check("Properties that can't be sharded should run in process.",
+        ok6 && ok7, "they did.", from_worker + covered);
+#endif
+}
+
+void test_collect()
+{
+    expect(property([] (const std::vector<int> & v)
+                    { collect("sum", std::accumulate(v.begin(), v.end(), 0.0)); return true; },
+        "Collect should summarize the lengths and sums of the inputs.")
+        .Rnd<0>(0, 100)
+        .Collect("length", [] (const std::vector<int> & v) { return v.size(); })
+    ());
+
+    // The values 0..99999, shuffled, summarized in two halves and merged.
+    std::vector<int> values(100000);
+    std::iota(values.begin(), values.end(), 0);
+    std::shuffle(values.begin(), values.end(), std::mt19937(42));
+    detail::Summary first, second;
+    for (size_t i = 0;i < values.size();++i) {
+        (i % 2 ? first : second).add(values[i]);
+    }
+    first.merge(second);
+
+    double median = first.sketch.quantile(0.5), p99 = first.sketch.quantile(0.99);
+    std::ostringstream summary, note;
+    first.print(summary, "values");
+    note<<"median "<<median<<", p99 "<<p99<<".";
+    check("Merged summaries should keep the mean and quantiles.",
+        first.stats.count == 100000 && std::abs(first.stats.mean - 49999.5) <= 1e-6 &&
+            std::abs(median - 50000) <= 1000 && std::abs(p99 - 99000) <= 1000 &&
+            first.stats.min == 0 && first.stats.max == 99999,
+        note.str(), summary.str());
+}
+
+void test_cover()
+{
+    auto classified = [] (int x) { return x < 50 ? "low" : "high"; };
+    expect(property([] (int x) { return x >= 0; },
+        "Met coverage requirements should stop the run early.")
+        .Rnd<0>(0, 99)
+        .Classify(classified)
+        .Cover("low", 30)
+        .Cover("high", 30)
+    (_100K));
+
+    bool ok;
+    std::string report = report_of(property([] (int x) { return x >= 0; },
+        "This covers high inputs too rarely.")
+        .Rnd<0>(0, 99)
+        .Classify(classified)
+        .Cover("high", 95), ok);
+
+    check("Insufficient coverage should fail early.",
+        !ok && report.find("Insufficient coverage") != std::string::npos &&
+            report.find("after 100 tests") != std::string::npos,
+        "it failed.", report);
+}
+
+void test_distribution()
+{
+    expect(distribution(Arbitrary<int>(0, 9),
+        "Arbitrary<int>(0, 9) should be uniform and uncorrelated.")
+        .Uniform(0, 9)
+        .SerialCorrelation()
+    ());
+
+    expect(distribution(Arbitrary<int>(),
+        "Arbitrary<int>() should be uniform over all the ints.")
+        .Uniform(std::numeric_limits<int>::min(), std::numeric_limits<int>::max())
+    ());
+
+    expect(distribution(Arbitrary<double>(-28., 2.),
+        "Arbitrary<double>(-28., 2.) should be uniform and uncorrelated.")
+        .Uniform(-28., 2.)
+        .SerialCorrelation()
+    ());
+
+    expect(distribution(Arbitrary<bool>(),
+        "Arbitrary<bool> should be fair.")
+        .ChiSquare([] (bool b) { return b; }, {0.5, 0.5})
+    ());
+
+    // Skewed and correlated generators should be caught.
+    Arbitrary<double> unit(0., 1.);
+    bool skewed = distribution([unit] () mutable { double x = unit(); return x * x; },
+        "", 0)
+        .Uniform(0., 1.)
+    ();
+    int k = 0;
+    bool correlated = distribution([&k, unit] () mutable { return (k++ % 2) + unit(); },
+        "", 0)
+        .SerialCorrelation()
+    ();
+
+    check("Skewed or correlated samples should fail the checks.",
+        !skewed && !correlated, "they did.",
+        std::string("skewed ") + (skewed ? "passed" : "failed") + ", correlated " +
+            (correlated ? "passed" : "failed") + ".\n");
+}
+
+// Counts its copies, see test_fix.
+struct Counted
+{
+    static int copies;
+    std::vector<int> payload;
+
+    Counted() {}
+    Counted(const Counted & other):payload(other.payload) { ++copies; }
+    Counted & operator=(const Counted & other) { payload = other.payload; ++copies; return *this; }
+};
+
+int Counted::copies = 0;
 
+void test_fix()
+{
+    Counted big;
+    big.payload.assign(_1M, 1);
+
+    Counted::copies = 0;
+    const Counted * first = nullptr;
+    bool ok = property([&first] (const Counted & c, int x) {
+                if (!first) first = &c;
+                return &c == first && c.payload.size() == _1M && x >= 0; },
+        "", 0)
+        .Fix<0>(big)
+        .Rnd<1>(0, 10)
+    ();
+    int const_copies = Counted::copies;
+
+    Counted::copies = 0;
+    ok &= property([] (Counted & c) { c.payload.clear(); return true; }, "", 0)
+        .Fix<0>(big)
+    (100);
+    int mutable_copies = Counted::copies;
+
+    check("Fix should copy only for non-const references.",
+        ok && const_copies <= 10 && mutable_copies >= 100,
+        std::to_string(const_copies) + " copies for 1000 tests.",
+        std::to_string(const_copies) + " copies for const &, " +
+            std::to_string(mutable_copies) + " for &.\n");
+}
+
+// A value that can only be moved.
+struct Token
+{
+    int value;
+
+    Token(int value = 0):value(value) {}
+    Token(Token && other) = default;
+    Token & operator=(Token && other) = default;
+    Token(const Token &) = delete;
+    Token & operator=(const Token &) = delete;
+};
+
+std::ostream & operator<<(std::ostream & out, const Token & t)
+{
+    return out<<"Token("<<t.value<<")";
+}
+
+void test_move_only()
+{
+    // The generator owns move-only state too.
+    bool ok1 = property([] (std::unique_ptr<int> p, Token t, const std::unique_ptr<int> & q) {
+                std::unique_ptr<int> owned = std::move(p);
+                return owned && q && *q >= 0 && *q <= 9 && t.value > 0; },
+        "", 0)
+        .Rnd<1>([next = std::make_unique<int>(0)] () mutable { return Token(++*next); })
+        .Rnd<2>(Arbitrary<std::unique_ptr<int>>(Arbitrary<int>(0, 9)))
+    ();
+
+    bool ok2;
+    std::string report = report_of(property([] (Token t) { return t.value < 50; }, "", 1)
+        .Rnd<0>([next = std::make_unique<int>(0)] () mutable { return Token(++*next); }), ok2);
+
+    check("Move-only arguments should be moved in.",
+        ok1 && !ok2 && report.find("after 50 tests") != std::string::npos &&
+            report.find("[Token(50)]") != std::string::npos,
+        "the first failure is Token(50).", report);
+}
+
+void test_print_limits()
+{
+    std::string path = temp_path();
+    save_full_inputs(path);
+    bool ok1, ok2, ok3;
+    std::string vectors = report_of(property([] (const std::vector<int> & v) {
+                return v.size() < 1000; }, "", 1)
+        .Rnd<0>(Arbitrary<std::vector<int>>(Arbitrary<int>(0, 9), 1000, 1000)), ok1);
+    save_full_inputs("");
+    std::ifstream file(path);
+    std::string full((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::remove(path.c_str());
+
+    std::string strings = report_of(property([] (const std::string & s) {
+                return s.size() < 10000; }, "", 1)
+        .Rnd<0>(Arbitrary<std::string>(10000, 10000)), ok2);
+
+    limit_printing(2, 1);
+    std::string nested = report_of(property([] (const std::vector<std::vector<int>> & v) {
+                return v.size() < 3; }, "", 1)
+        .Rnd<0>(Arbitrary<std::vector<std::vector<int>>>(
+                    Arbitrary<std::vector<int>>(5, 5), 3, 3)), ok3);
+    limit_printing(100);
+
+    check("Huge inputs should be printed within the limits.",
+        !ok1 && !ok2 && !ok3 && vectors.size() <= 1000 &&
+            vectors.find("... 900 more, 1000 in all>") != std::string::npos &&
+            std::count(full.begin(), full.end(), ',') == 1000 &&
+            strings.size() <= 5000 && strings.find("...]") != std::string::npos &&
+            nested.find("[V<V<5 elements>, V<5 elements>, ... 1 more, 3 in all>]") !=
+                std::string::npos,
+        std::to_string(vectors.size()) + " characters for 1000 elements.",
+        vectors + strings + nested);
+}
+
+void test_edges()
+{
+    auto below_max = [] (int x) { return x < std::numeric_limits<int>::max(); };
+    bool ok1, ok2, ok3;
+    std::string ints = report_of(property(below_max, "", 1).Edges(0.1), ok1);
+    std::string reals = report_of(property([] (double x) { return !std::isnan(x); }, "", 1)
+        .Rnd<0>(Arbitrary<double>().Specials()).Edges(0.1), ok2);
+    // Without Edges, the values are uniform.
+    std::string uniform = report_of(property(below_max, "", 1), ok3);
+
+    check("Edge cases should be mixed in and counted.",
+        !ok1 && ints.find("[2147483647]") != std::string::npos &&
+            ints.find("edge cases:") != std::string::npos &&
+            !ok2 && reals.find("NaN.") != std::string::npos &&
+            ok3 && uniform.find("edge cases") == std::string::npos,
+        "found max and NaN.", ints + reals + uniform);
+}
+
+void test_engines()
+{
+    // Generators hold no engine, so constructing them doesn't allocate.
+    detail::AllocPhase phase = detail::alloc_phase();
+    detail::alloc_phase() = detail::ALLOC_GENERATION;
+    int64_t before = detail::alloc_counters()[detail::ALLOC_GENERATION].allocations;
+    for (int i = 0;i < 1000;++i) {
+        Arbitrary<int> ints(0, i);
+        Arbitrary<double> reals(-i, i);
+    }
+    int64_t allocations = detail::alloc_counters()[detail::ALLOC_GENERATION].allocations -
+        before;
+    detail::alloc_phase() = phase;
+
+    // The copies of a property draw the same inputs.
+    auto prop = property([] (const std::vector<int> & v) { return v.size() < 20; }, "", 1);
+    bool ok1, ok2;
+    std::string first = report_of(prop, ok1);
+    std::string second = report_of(prop, ok2);
+
+    check("Generators should be cheap and draw from the property.",
+        (!detail::alloc_counting_installed() || allocations == 0) &&
+            sizeof(Arbitrary<int>) <= 32 && !ok1 && !ok2 && first == second,
+        std::to_string(sizeof(Arbitrary<int>)) + " bytes and no allocations per generator.",
+        std::to_string(allocations) + " allocations, " +
+            std::to_string(sizeof(Arbitrary<int>)) + " bytes, reports:\n" + first + second);
+}
+
+struct Header
+{
+    uint16_t port;
+    uint8_t mac[6];
+    uint32_t seq;
+};
+
+struct Sample
+{
+    Header header;
+    double value;
+};
+
+void test_aggregates()
+{
+    bool ok1, ok2, ok3;
+    std::string filled = report_of(property([] (const Header & h)
+                { return h.seq < 4000000000u || h.mac[5] < 200; }, "", 1), ok1);
+    std::string set = report_of(property([] (const Header & h)
+                { return h.port == 80 && h.seq <= 9; }, "", 1)
+        .Rnd<0>(Arbitrary<Header>().Fix<0>(80).Rnd<2>(0, 9)), ok2);
+    std::string nested = report_of(property([] (const Sample & s)
+                { return s.value >= -1 && s.value <= 1 && s.header.port != 0; }, "", 1)
+        .Rnd<0>(Arbitrary<Sample>().Rnd<0>(Arbitrary<Header>().One<0>({1, 2, 3}))), ok3);
+
+    check("Aggregates should be filled with random bytes or by field.",
+        !ok1 && ok2 && ok3, "found a large seq and kept the fields set.",
+        filled + set + nested);
+}
+
+void test_streams()
+{
+    // Every pass, in any chunks, draws the same elements.
+    expect(property([] (const Stream<unsigned char> & s) {
+                uint64_t sum = 0, n = 0;
+                for (unsigned char c:s) {
+                    sum += c;
+                    ++n;
+                }
+                auto reader = s.reader();
+                std::vector<unsigned char> chunk(1 + s.seed() % 10000);
+                uint64_t again = 0;
+                for (size_t k;(k = reader.read(chunk.data(), chunk.size())) > 0;) {
+                    again += std::accumulate(chunk.begin(), chunk.begin() + k, uint64_t(0));
+                }
+                return n == s.size() && sum == again;
+            },
+        "Streams should be the same on every pass.")
+        .Rnd<0>(Arbitrary<Stream<unsigned char>>(0, 1 << 22))
+    (20));
+
+    // A failing stream is reported by its seed, and built again from it.
+    bool ok;
+    auto long_or_odd = [] (const Stream<int> & s) {
+        return s.size() < 1000000 || std::all_of(s.begin(), s.end(),
+                [] (int x) { return x % 2 == 0; });
+    };
+    std::string report = report_of(property(long_or_odd, "", 1)
+        .Rnd<0>(Arbitrary<Stream<int>>(Arbitrary<int>(0, 100), 1000000, 2000000)), ok);
+    size_t at = report.find(" more, ");
+    size_t length = 0;
+    uint64_t seed = 0;
+    if (at != std::string::npos) {
+        std::istringstream(report.substr(at + 7))>>length;
+        std::istringstream(report.substr(report.find("seed ", at) + 5))>>seed;
+    }
+    Stream<int> rebuilt(Arbitrary<int>(0, 100), length, seed);
+
+    check("A failing stream should be built again from its seed.",
+        !ok && at != std::string::npos && !long_or_odd(rebuilt),
+        std::to_string(length) + " elements from seed " + std::to_string(seed) + ".", report);
+}
+
+void test_complexity()
+{
+    expect(complexity([](std::vector<int> &v)
+                    { volatile long sum = std::accumulate(v.begin(), v.end(), 0L);
+                      (void)sum; },
+        Order::O_N,
+        "Summing a vector should be linear.")
+    ());
+
+    expect(complexity([](std::vector<int> &v) { std::sort(v.begin(), v.end()); },
+        Order::O_N_LOG_N,
+        "Sorting a vector should be O(n log n).")
+    ());
+
+    // The first access misses the cache more often on larger vectors, so
+    // the repetitions amortize it.
+    expect(complexity([](std::vector<int> &v) { volatile int x = v[v.size() / 2]; (void)x; },
+        Order::O_1,
+        "Indexing a vector should be constant.")
+        .Reps(10000)
+    ());
+
+    bool ok;
+    std::string report = report_of(complexity([](std::vector<int> &v)
+                    { long smaller = 0;
+                      for (size_t i = 0;i < v.size();++i)
+                          for (size_t j = 0;j < v.size();++j) smaller += v[j] < v[i];
+                      volatile long sink = smaller; (void)sink; },
+        Order::O_N,
+        "Comparing all the pairs isn't linear."), ok, 1 << 6, 1 << 11);
+    check("A quadratic function declared linear should fail.",
+        !ok && report.find("observed O(n^2)") != std::string::npos, "it failed.", report);
+}
+
+void test_stateful()
+{
+    expect(stateful<std::deque<int>, std::vector<int>>(
+            "A deque used as a queue should behave like a vector.")
+        .Command("push_back",
+            [](std::deque<int> &q, const int &x) { q.push_back(x); },
+            [](std::vector<int> &v, const int &x) { v.push_back(x); })
+        .Weight(2)
+        .Command("pop_front",
+            [](std::deque<int> &q) { int x = q.front(); q.pop_front(); return x; },
+            [](std::vector<int> &v) { int x = v.front(); v.erase(v.begin()); return x; })
+        .Pre([](const std::vector<int> &v) { return !v.empty(); })
+        .Command("size",
+            [](std::deque<int> &q) { return q.size(); },
+            [](std::vector<int> &v) { return v.size(); })
+        .Invariant([](const std::deque<int> &q, const std::vector<int> &v)
+            { return q.size() == v.size(); })
+    (_1K));
+}
+
+// A set that serializes every operation with a mutex.
+struct LockedSet
+{
+    std::mutex m;
+    std::set<int> s;
+
+    bool insert(int x) { std::lock_guard<std::mutex> g(m); return s.insert(x).second; }
+    bool erase(int x) { std::lock_guard<std::mutex> g(m); return s.erase(x) > 0; }
+    bool find(int x) { std::lock_guard<std::mutex> g(m); return s.count(x) > 0; }
+};
+
+void test_linearizability()
+{
+    expect(stateful<LockedSet, std::set<int>>(
+            "A mutex protected set should be linearizable.")
+        .Command("insert", Arbitrary<int>(0, 5),
+            [](LockedSet &s, const int &x) { return s.insert(x); },
+            [](std::set<int> &s, const int &x) { return s.insert(x).second; })
+        .Command("erase", Arbitrary<int>(0, 5),
+            [](LockedSet &s, const int &x) { return s.erase(x); },
+            [](std::set<int> &s, const int &x) { return s.erase(x) > 0; })
+        .Command("find", Arbitrary<int>(0, 5),
+            [](LockedSet &s, const int &x) { return s.find(x); },
+            [](std::set<int> &s, const int &x) { return s.count(x) > 0; })
+        .Threads(4)
+    (_1K, 10));
+
+    auto machine = stateful<LockedSet, std::set<int>>("", 1);
+    machine
+        .Command("insert", Arbitrary<int>(0, 5),
+            [](LockedSet &s, const int &x) { return s.insert(x); },
+            [](std::set<int> &s, const int &x) { return s.insert(x).second; })
+        .Command("erase", Arbitrary<int>(0, 5),
+            [](LockedSet &s, const int &x) { return s.erase(x); },
+            [](std::set<int> &s, const int &x) { return s.erase(x) > 0; })
+        .Pre([](const std::set<int> &s, const int &x) { return s.count(x) > 0; })
+        .Threads(4);
+    bool ok;
+    std::string report = report_of(std::move(machine), ok);
+
+    check("Preconditions under Threads should be rejected.",
+        !ok && report.find("Unsupported") != std::string::npos, "it was rejected.", report);
+}
 
 int main()
 {
@@ -186,5 +1033,32 @@ int main()
     test_arbit_bounded();
     test_oneof();
     test_vector();
+    test_exhaustive();
+    test_dedup();
+    test_cache();
+    test_combinators();
+    test_coroutines();
+    test_async();
+    test_perf();
+    test_baseline();
+    test_allocations();
+    test_shards();
+    test_collect();
+    test_cover();
+    test_distribution();
+    test_fix();
+    test_move_only();
+    test_print_limits();
+    test_edges();
+    test_engines();
+    test_aggregates();
+    test_streams();
+    test_complexity();
+    test_stateful();
+    test_linearizability();
     std::cout<<"===========tests end=================="<<std::endl;
+    if (failures) {
+        std::cout<<MAKE_RED("*** Failed,")<<" "<<failures<<" checks or properties."<<std::endl;
+    }
+    return failures ? 1 : 0;
 }